@@ -0,0 +1,147 @@
+/**
+ * Merge throughput as the fan-in grows from 2 to 1024.
+ *
+ * A fixed number of records is spread over k sorted in-memory runs and merged once per iteration, either with the
+ * LoserTree used by Sorter::merge_sort or with the std::priority_queue it replaced. Keys are real SortKey encodings
+ * of (id, timestamp) rows like the ones benchmark/generate produces.
+ *
+ * Run with: ./mergebench --benchmark_counters_tabular=true
+ */
+#include "LoserTree.h"
+#include "RowTable.h"
+#include "SortKey.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+const size_t TOTAL_RECORDS = 1 << 20;
+
+struct Record
+{
+    uint64_t prefix;
+    std::string key;
+};
+
+class VectorCursor
+{
+private:
+    const std::vector<Record> *m_records;
+    size_t m_pos;
+
+public:
+    VectorCursor(const std::vector<Record> *records) : m_records(records), m_pos(0) {}
+    bool exhausted() const { return m_pos >= m_records->size(); }
+    uint64_t key_prefix() const { return (*m_records)[m_pos].prefix; }
+    std::string_view key() const { return (*m_records)[m_pos].key; }
+    void next() { ++m_pos; }
+};
+
+std::vector<std::vector<Record>> make_runs(size_t k)
+{
+    static const char alphanum[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> len(3, 5);
+    std::uniform_int_distribution<size_t> chr(0, sizeof(alphanum) - 2);
+    std::uniform_int_distribution<int> ts(100, 1000);
+
+    RowTable table;
+    table.set_key_columns({0, 1});
+    std::vector<std::vector<Record>> runs(k);
+    for (size_t i = 0; i < TOTAL_RECORDS; ++i)
+    {
+        std::string line;
+        for (int c = len(gen); c > 0; --c)
+        {
+            line.push_back(alphanum[chr(gen)]);
+        }
+        line += "," + std::to_string(ts(gen));
+
+        table.clear();
+        table.append(line);
+        std::string key(table.key(table.rows()[0]));
+        runs[i % k].push_back(Record{SortKey::prefix(key), key});
+    }
+
+    for (auto &run : runs)
+    {
+        std::sort(run.begin(), run.end(), [](const Record &a, const Record &b)
+                  { return SortKey::is_smaller(a.key, b.key); });
+    }
+    return runs;
+}
+
+static void BM_LoserTree(benchmark::State &state)
+{
+    auto runs = make_runs(static_cast<size_t>(state.range(0)));
+    for (auto _ : state)
+    {
+        std::vector<VectorCursor> cursors;
+        for (const auto &run : runs)
+        {
+            cursors.emplace_back(&run);
+        }
+        std::vector<VectorCursor *> inputs;
+        for (auto &c : cursors)
+        {
+            inputs.push_back(&c);
+        }
+
+        LoserTree<VectorCursor> tree(inputs);
+        size_t checksum = 0;
+        while (!tree.empty())
+        {
+            checksum += tree.top_index();
+            tree.pop();
+        }
+        benchmark::DoNotOptimize(checksum);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * TOTAL_RECORDS));
+}
+
+static void BM_PriorityQueue(benchmark::State &state)
+{
+    auto runs = make_runs(static_cast<size_t>(state.range(0)));
+    for (auto _ : state)
+    {
+        std::vector<VectorCursor> cursors;
+        for (const auto &run : runs)
+        {
+            cursors.emplace_back(&run);
+        }
+
+        auto compare = [&cursors](size_t a, size_t b)
+        {
+            return SortKey::is_smaller(cursors[b].key(), cursors[a].key());
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(compare)> heap(compare);
+        for (size_t i = 0; i < cursors.size(); ++i)
+        {
+            heap.push(i);
+        }
+
+        size_t checksum = 0;
+        while (!heap.empty())
+        {
+            size_t i = heap.top();
+            heap.pop();
+            checksum += i;
+            cursors[i].next();
+            if (!cursors[i].exhausted())
+            {
+                heap.push(i);
+            }
+        }
+        benchmark::DoNotOptimize(checksum);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * TOTAL_RECORDS));
+}
+
+BENCHMARK(BM_LoserTree)->RangeMultiplier(2)->Range(2, 1024)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PriorityQueue)->RangeMultiplier(2)->Range(2, 1024)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
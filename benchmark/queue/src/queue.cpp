@@ -0,0 +1,99 @@
+/**
+ * Log lines per second through SafeQueue and MPMCQueue with 1 to 64 producer threads and a single consumer, the way
+ * the sort workers log through log_queue to the LogProcessor. The consumer takes lines one by one, or in batches of up
+ * to BATCH lines with MPMCQueue::dequeue_n.
+ *
+ * Run with: ./queuebench --benchmark_counters_tabular=true
+ */
+#include "MPMCQueue.h"
+#include "SafeQueue.h"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+const size_t LINES = 1 << 18;
+const size_t CAPACITY = 64 * 1024;
+const size_t BATCH = 256;
+const std::string LINE = "2024/01/01 12:00:00.000000 [INFO] [Sorter] Sorting chunk of 16384 rows and writing to 'run'";
+
+template <typename Queue, typename Consume>
+void produce_and_consume(Queue &queue, size_t producers, Consume consume)
+{
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&queue, producers]()
+                             {
+            for (size_t i = 0; i < LINES / producers; ++i)
+            {
+                queue.enqueue(LINE);
+            } });
+    }
+
+    consume(LINES / producers * producers);
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+static void BM_SafeQueue(benchmark::State &state)
+{
+    const size_t producers = static_cast<size_t>(state.range(0));
+    for (auto _ : state)
+    {
+        SafeQueue<std::string> queue;
+        produce_and_consume(queue, producers, [&queue](size_t lines)
+                            {
+            for (size_t i = 0; i < lines; ++i)
+            {
+                benchmark::DoNotOptimize(queue.dequeue());
+            } });
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * LINES));
+}
+
+static void BM_MPMCQueue(benchmark::State &state)
+{
+    const size_t producers = static_cast<size_t>(state.range(0));
+    for (auto _ : state)
+    {
+        MPMCQueue<std::string> queue(CAPACITY);
+        produce_and_consume(queue, producers, [&queue](size_t lines)
+                            {
+            for (size_t i = 0; i < lines; ++i)
+            {
+                benchmark::DoNotOptimize(queue.dequeue());
+            } });
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * LINES));
+}
+
+static void BM_MPMCQueueBatched(benchmark::State &state)
+{
+    const size_t producers = static_cast<size_t>(state.range(0));
+    for (auto _ : state)
+    {
+        MPMCQueue<std::string> queue(CAPACITY);
+        produce_and_consume(queue, producers, [&queue](size_t lines)
+                            {
+            std::vector<std::string> batch;
+            for (size_t taken = 0; taken < lines; taken += batch.size())
+            {
+                batch.clear();
+                queue.dequeue_n(batch, BATCH);
+                benchmark::DoNotOptimize(batch.data());
+            } });
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * LINES));
+}
+
+BENCHMARK(BM_SafeQueue)->RangeMultiplier(2)->Range(1, 64)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_MPMCQueue)->RangeMultiplier(2)->Range(1, 64)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_MPMCQueueBatched)->RangeMultiplier(2)->Range(1, 64)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,81 @@
+/**
+ * Sorting a chunk of rows with RadixSort against the std::sort path CSV::sort_in_memory used before.
+ *
+ * Rows are (id, timestamp) lines like the ones benchmark/generate produces, sorted either by timestamp alone
+ * (9 byte keys) or by id and timestamp (15 to 17 byte keys). Every iteration sorts the rows from their load order.
+ *
+ * Run with: ./radixbench --benchmark_counters_tabular=true
+ */
+#include "RadixSort.h"
+#include "RowTable.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+RowTable make_table(size_t rows, const std::vector<size_t> &key_columns)
+{
+    static const char alphanum[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> len(3, 5);
+    std::uniform_int_distribution<size_t> chr(0, sizeof(alphanum) - 2);
+    std::uniform_int_distribution<int> ts(100, 1000000);
+
+    RowTable table;
+    table.set_key_columns(key_columns);
+    for (size_t i = 0; i < rows; ++i)
+    {
+        std::string line;
+        for (int c = len(gen); c > 0; --c)
+        {
+            line.push_back(alphanum[chr(gen)]);
+        }
+        line += "," + std::to_string(ts(gen));
+        table.append(line);
+    }
+    return table;
+}
+
+std::vector<size_t> key_columns(int64_t arg)
+{
+    return arg == 0 ? std::vector<size_t>{1} : std::vector<size_t>{0, 1};
+}
+
+static void BM_StdSort(benchmark::State &state)
+{
+    RowTable table = make_table(static_cast<size_t>(state.range(0)), key_columns(state.range(1)));
+    const std::vector<RowRef> unsorted = table.rows();
+    for (auto _ : state)
+    {
+        table.rows() = unsorted;
+        std::sort(table.rows().begin(), table.rows().end(), [&table](const RowRef &a, const RowRef &b)
+                  { return table.is_smaller(a, b); });
+        benchmark::DoNotOptimize(table.rows().data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * state.range(0)));
+}
+
+static void BM_RadixSort(benchmark::State &state)
+{
+    RowTable table = make_table(static_cast<size_t>(state.range(0)), key_columns(state.range(1)));
+    const std::vector<RowRef> unsorted = table.rows();
+    for (auto _ : state)
+    {
+        table.rows() = unsorted;
+        if (!RadixSort::sort(table))
+        {
+            state.SkipWithError("keys not radix sortable");
+            break;
+        }
+        benchmark::DoNotOptimize(table.rows().data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * state.range(0)));
+}
+
+BENCHMARK(BM_StdSort)->ArgsProduct({benchmark::CreateRange(1 << 12, 1 << 22, 8), {0, 1}})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RadixSort)->ArgsProduct({benchmark::CreateRange(1 << 12, 1 << 22, 8), {0, 1}})->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
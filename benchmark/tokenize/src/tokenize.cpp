@@ -0,0 +1,178 @@
+/**
+ * Tokenizer throughput in GB/s: the character by character state machine RowTable::append used before, against
+ * CSVTokenizer with every kernel this CPU supports.
+ *
+ * Two inputs: short unquoted lines like the ones benchmark/generate writes, and wide rows with every field quoted
+ * (some with delimiters inside) like the sorted runs.
+ *
+ * Run with: ./tokenizebench --benchmark_counters_tabular=true
+ */
+#include "CSVTokenizer.h"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+const size_t INPUT_BYTES = 16 * 1024 * 1024;
+
+std::string random_string(std::mt19937 &gen, size_t min_length, size_t max_length)
+{
+    static const char alphanum[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    std::uniform_int_distribution<size_t> len(min_length, max_length);
+    std::uniform_int_distribution<size_t> chr(0, sizeof(alphanum) - 2);
+
+    std::string s;
+    for (size_t i = len(gen); i > 0; --i)
+    {
+        s.push_back(alphanum[chr(gen)]);
+    }
+    return s;
+}
+
+const std::vector<std::string> &lines(int input)
+{
+    static std::vector<std::string> inputs[2];
+    std::vector<std::string> &result = inputs[input];
+    if (result.empty())
+    {
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<int> ts(100, 1000);
+        size_t bytes = 0;
+        while (bytes < INPUT_BYTES)
+        {
+            std::string line;
+            if (input == 0)
+            {
+                line = random_string(gen, 3, 5) + "," + std::to_string(ts(gen));
+            }
+            else
+            {
+                for (int c = 0; c < 8; ++c)
+                {
+                    line += (c > 0 ? ",\"" : "\"") + random_string(gen, 4, 24) + (c == 5 ? ", " + random_string(gen, 2, 8) : "") + "\"";
+                }
+            }
+            bytes += line.size() + 1;
+            result.push_back(line);
+        }
+    }
+    return result;
+}
+
+/**
+ * RowTable::append before CSVTokenizer.
+ */
+size_t tokenize_state_machine(std::string_view line, std::string &bytes, std::vector<FieldRef> &fields)
+{
+    CSVState state = CSVState::UnquotedField;
+    size_t field_count = 1;
+    fields.push_back(FieldRef{static_cast<uint32_t>(bytes.size()), 0});
+
+    for (char c : line)
+    {
+        switch (state)
+        {
+        case CSVState::UnquotedField:
+            switch (c)
+            {
+            case ',': // end of field
+                fields.push_back(FieldRef{static_cast<uint32_t>(bytes.size()), 0});
+                field_count++;
+                break;
+            case '"':
+                state = CSVState::QuotedField;
+                break;
+            default:
+                bytes.push_back(c);
+                fields.back().length++;
+                break;
+            }
+            break;
+        case CSVState::QuotedField:
+            switch (c)
+            {
+            case '"':
+                state = CSVState::QuotedQuote;
+                break;
+            default:
+                bytes.push_back(c);
+                fields.back().length++;
+                break;
+            }
+            break;
+        case CSVState::QuotedQuote:
+            switch (c)
+            {
+            case ',': // , after closing quote
+                fields.push_back(FieldRef{static_cast<uint32_t>(bytes.size()), 0});
+                field_count++;
+                state = CSVState::UnquotedField;
+                break;
+            case '"': // "" -> "
+                bytes.push_back('"');
+                fields.back().length++;
+                state = CSVState::QuotedField;
+                break;
+            default: // end of quote
+                state = CSVState::UnquotedField;
+                break;
+            }
+            break;
+        }
+    }
+    return field_count;
+}
+
+template <typename Tokenize>
+void run(benchmark::State &state, Tokenize tokenize)
+{
+    const auto &input = lines(static_cast<int>(state.range(0)));
+    size_t input_bytes = 0;
+    for (const auto &line : input)
+    {
+        input_bytes += line.size() + 1;
+    }
+
+    // Reused like the arena of a RowTable
+    std::string bytes;
+    std::vector<FieldRef> fields;
+    for (auto _ : state)
+    {
+        bytes.clear();
+        fields.clear();
+        for (const auto &line : input)
+        {
+            benchmark::DoNotOptimize(tokenize(line, bytes, fields));
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * input_bytes);
+}
+
+static void BM_StateMachine(benchmark::State &state)
+{
+    run(state, tokenize_state_machine);
+}
+BENCHMARK(BM_StateMachine)->ArgName("quoted")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+static void BM_CSVTokenizer(benchmark::State &state)
+{
+    auto implementation = static_cast<CSVTokenizer::Implementation>(state.range(1));
+    if (!CSVTokenizer::is_supported(implementation))
+    {
+        state.SkipWithError(("no " + CSVTokenizer::to_string(implementation) + " on this CPU").c_str());
+        return;
+    }
+
+    state.SetLabel(CSVTokenizer::to_string(implementation));
+    run(state, [implementation](std::string_view line, std::string &bytes, std::vector<FieldRef> &fields)
+        { return CSVTokenizer::tokenize(line, bytes, fields, implementation); });
+}
+BENCHMARK(BM_CSVTokenizer)
+    ->ArgNames({"quoted", "kernel"})
+    ->ArgsProduct({{0, 1}, {static_cast<int>(CSVTokenizer::Implementation::Scalar), static_cast<int>(CSVTokenizer::Implementation::SSE42), static_cast<int>(CSVTokenizer::Implementation::AVX2)}})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
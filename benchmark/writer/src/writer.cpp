@@ -0,0 +1,88 @@
+/**
+ * Rows per second written to a file, the way the merge and the resampler wrote them before (std::endl and a flush
+ * per row) and through BufferedWriter, with and without the background writer thread.
+ *
+ * Run with: ./writerbench --benchmark_counters_tabular=true
+ */
+#include "BufferedWriter.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+const size_t ROWS = 1 << 18;
+const char *OUTPUT_PATH = "writerbench.csv";
+
+const std::vector<std::string> &rows()
+{
+    static std::vector<std::string> rows;
+    if (rows.empty())
+    {
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<int> id(1000, 9999);
+        std::uniform_int_distribution<int> ts(100, 1000);
+        std::uniform_real_distribution<double> value(0.0, 100.0);
+        for (size_t i = 0; i < ROWS; ++i)
+        {
+            rows.push_back("\"" + std::to_string(id(gen)) + "\",\"" + std::to_string(ts(gen)) + "\",\"" + std::to_string(value(gen)) + "\"");
+        }
+    }
+    return rows;
+}
+
+static void BM_OfstreamFlushEveryRow(benchmark::State &state)
+{
+    const auto &lines = rows();
+    for (auto _ : state)
+    {
+        std::ofstream out(OUTPUT_PATH);
+        for (const auto &line : lines)
+        {
+            out << line << std::endl;
+            flush(out);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * lines.size());
+    std::remove(OUTPUT_PATH);
+}
+BENCHMARK(BM_OfstreamFlushEveryRow)->Unit(benchmark::kMillisecond);
+
+static void BM_Ofstream(benchmark::State &state)
+{
+    const auto &lines = rows();
+    for (auto _ : state)
+    {
+        std::ofstream out(OUTPUT_PATH);
+        for (const auto &line : lines)
+        {
+            out << line << '\n';
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * lines.size());
+    std::remove(OUTPUT_PATH);
+}
+BENCHMARK(BM_Ofstream)->Unit(benchmark::kMillisecond);
+
+static void BM_BufferedWriter(benchmark::State &state)
+{
+    const auto &lines = rows();
+    const bool background = state.range(1) != 0;
+    for (auto _ : state)
+    {
+        BufferedWriter out(OUTPUT_PATH, state.range(0) * 1024, FlushPolicy::WhenFull, background);
+        for (const auto &line : lines)
+        {
+            out.write_line(line);
+        }
+        out.close();
+    }
+    state.SetItemsProcessed(state.iterations() * lines.size());
+    std::remove(OUTPUT_PATH);
+}
+BENCHMARK(BM_BufferedWriter)->ArgNames({"kb", "background"})->ArgsProduct({{64, 1024, 8192}, {0, 1}})->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
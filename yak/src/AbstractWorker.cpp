@@ -9,9 +9,10 @@ void AbstractWorker::run()
 
   while (!m_sig_channel->m_shutdown_requested.load())
   {
+    if (m_pause.count() > 0)
     {
       std::unique_lock shutdown_lock(m_sig_channel->m_cv_mutex);
-      m_sig_channel->m_cv.wait_for(shutdown_lock, std::chrono::milliseconds(10), [this]()
+      m_sig_channel->m_cv.wait_for(shutdown_lock, m_pause, [this]()
                                    { bool should_shutdown = m_sig_channel->m_shutdown_requested.load();
                                      return should_shutdown; });
     }
@@ -5,6 +5,7 @@
 #include "PollResult.h"
 #include "SignalChannel.h"
 #include "ThreadGuard.h"
+#include <chrono>
 #include <string>
 #include <memory>
 #include <thread>
@@ -13,7 +14,8 @@ class AbstractWorker
 {
 
 public:
-  AbstractWorker(std::string name, std::shared_ptr<SignalChannel> sig_channel) : m_name(name), m_sig_channel(sig_channel){};
+  // pause: between two steps, 0 for workers whose step() waits for work itself
+  AbstractWorker(std::string name, std::shared_ptr<SignalChannel> sig_channel, std::chrono::milliseconds pause = std::chrono::milliseconds(10)) : m_name(name), m_sig_channel(sig_channel), m_pause(pause){};
   void set_queue(std::shared_ptr<SafeQueue<PollResult>> queue_);
   void run();
   ~AbstractWorker(){};
@@ -21,9 +23,11 @@ public:
 protected:
   std::shared_ptr<SafeQueue<PollResult>> m_queue;
   const std::string m_name;
+  std::shared_ptr<SignalChannel> m_sig_channel;
 
 private:
-  std::shared_ptr<SignalChannel> m_sig_channel;
+  const std::chrono::milliseconds m_pause;
+
   virtual void step() = 0;
   virtual void clean() = 0;
 };
@@ -0,0 +1,143 @@
+#include "AlignedBuffer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+namespace
+{
+    char *allocate(size_t size)
+    {
+        void *data = std::aligned_alloc(AlignedBuffer::ALIGNMENT, size);
+        if (data == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return static_cast<char *>(data);
+    }
+}
+
+AlignedBuffer::AlignedBuffer() : m_data(nullptr), m_size(0), m_pool(nullptr)
+{
+}
+
+AlignedBuffer::AlignedBuffer(size_t size) : m_data(nullptr), m_size(align_up(size)), m_pool(nullptr)
+{
+    if (m_size > 0)
+    {
+        m_data = allocate(m_size);
+    }
+}
+
+AlignedBuffer::AlignedBuffer(char *data, size_t size, AlignedBufferPool *pool) : m_data(data), m_size(size), m_pool(pool)
+{
+}
+
+AlignedBuffer::~AlignedBuffer()
+{
+    if (m_data == nullptr)
+    {
+        return;
+    }
+
+    if (m_pool != nullptr)
+    {
+        m_pool->release(m_data, m_size);
+    }
+    else
+    {
+        std::free(m_data);
+    }
+}
+
+AlignedBuffer::AlignedBuffer(AlignedBuffer &&other) noexcept : m_data(std::exchange(other.m_data, nullptr)),
+                                                               m_size(std::exchange(other.m_size, 0)),
+                                                               m_pool(std::exchange(other.m_pool, nullptr))
+{
+}
+
+AlignedBuffer &AlignedBuffer::operator=(AlignedBuffer &&other) noexcept
+{
+    if (this != &other)
+    {
+        AlignedBuffer old(std::move(*this));
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+        m_pool = std::exchange(other.m_pool, nullptr);
+    }
+    return *this;
+}
+
+size_t AlignedBuffer::align_up(size_t size)
+{
+    return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+size_t AlignedBuffer::align_down(size_t size)
+{
+    return size / ALIGNMENT * ALIGNMENT;
+}
+
+AlignedBufferPool::AlignedBufferPool(size_t max_free_bytes) : m_max_free_bytes(max_free_bytes),
+                                                               m_free_bytes(0)
+{
+}
+
+AlignedBufferPool::~AlignedBufferPool()
+{
+    for (auto &[size, buffers] : m_free)
+    {
+        for (char *data : buffers)
+        {
+            std::free(data);
+        }
+    }
+}
+
+AlignedBuffer AlignedBufferPool::acquire(size_t size)
+{
+    size = size_class(size);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_free.find(size);
+        if (it != m_free.end() && !it->second.empty())
+        {
+            char *data = it->second.back();
+            it->second.pop_back();
+            m_free_bytes -= size;
+            return AlignedBuffer(data, size, this);
+        }
+    }
+    return AlignedBuffer(allocate(size), size, this);
+}
+
+void AlignedBufferPool::release(char *data, size_t size)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_free_bytes + size <= m_max_free_bytes)
+        {
+            m_free[size].push_back(data);
+            m_free_bytes += size;
+            return;
+        }
+    }
+    std::free(data);
+}
+
+/**
+ * Smallest of 1, 1.25, 1.5 and 1.75 times a power of two that holds size, in whole blocks of AlignedBuffer::ALIGNMENT.
+ *
+ */
+size_t AlignedBufferPool::size_class(size_t size)
+{
+    size = std::max(AlignedBuffer::align_up(size), AlignedBuffer::ALIGNMENT);
+    size_t power = AlignedBuffer::ALIGNMENT;
+    while (power * 2 <= size)
+    {
+        power *= 2;
+    }
+    const size_t step = std::max(power / 4, AlignedBuffer::ALIGNMENT);
+    return (size + step - 1) / step * step;
+}
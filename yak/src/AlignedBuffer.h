@@ -0,0 +1,74 @@
+#ifndef ALIGNED_BUFFER_H
+#define ALIGNED_BUFFER_H
+
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class AlignedBufferPool;
+
+/**
+ * Block of memory whose address and size are multiples of ALIGNMENT, as O_DIRECT I/O needs them. Move only; the
+ * memory goes back to the pool it came from (if any) when the buffer goes away.
+ */
+class AlignedBuffer
+{
+public:
+    static constexpr size_t ALIGNMENT = 4096;
+
+private:
+    char *m_data;
+    size_t m_size;
+    AlignedBufferPool *m_pool;
+
+public:
+    AlignedBuffer();
+    explicit AlignedBuffer(size_t size);
+    AlignedBuffer(char *data, size_t size, AlignedBufferPool *pool);
+    ~AlignedBuffer();
+    AlignedBuffer(AlignedBuffer &&other) noexcept;
+    AlignedBuffer &operator=(AlignedBuffer &&other) noexcept;
+    AlignedBuffer(const AlignedBuffer &) = delete;
+    AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+
+    char *data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+    static size_t align_up(size_t size);
+    static size_t align_down(size_t size);
+};
+
+/**
+ * Recycles aligned buffers, so the streams of a sort don't allocate and fault in fresh memory for every run. Thread
+ * safe.
+ *
+ * Sizes are rounded up to a size class (four per power of two, so at most a quarter is wasted): buffers of merges
+ * whose sizes differ a little from batch to batch still come from the same free list. Buffers given back are kept
+ * for reuse up to max_free_bytes in total and freed beyond that, so a long-running process doesn't keep every size it
+ * ever used. The pool has to outlive the buffers it handed out.
+ */
+class AlignedBufferPool
+{
+private:
+    std::mutex m_mutex;
+    std::unordered_map<size_t, std::vector<char *>> m_free;
+    size_t m_max_free_bytes;
+    size_t m_free_bytes;
+
+public:
+    explicit AlignedBufferPool(size_t max_free_bytes);
+    ~AlignedBufferPool();
+    AlignedBufferPool(const AlignedBufferPool &) = delete;
+    AlignedBufferPool &operator=(const AlignedBufferPool &) = delete;
+
+    /**
+     * A buffer of at least size bytes (size rounded up to its size class).
+     */
+    AlignedBuffer acquire(size_t size);
+    void release(char *data, size_t size);
+
+    static size_t size_class(size_t size);
+};
+
+#endif
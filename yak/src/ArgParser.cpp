@@ -1,5 +1,7 @@
 #include "ArgParser.h"
 
+#include <algorithm>
+
 ArgParser::ArgParser(int &argc, char **argv)
 {
     for (int i = 1; i < argc; ++i)
@@ -0,0 +1,63 @@
+#include "BatchPolicy.h"
+
+#include <filesystem>
+#include <system_error>
+
+BatchPolicy::BatchPolicy(const BatchOptions &options) : m_options(options)
+{
+}
+
+void BatchPolicy::add(const std::string &file_path)
+{
+    if (m_files == 0)
+    {
+        m_first_added = std::chrono::steady_clock::now();
+    }
+    ++m_files;
+
+    // A file gone by now counts as empty, the sorter will complain about it
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(file_path, ec);
+    m_bytes += ec ? 0 : size;
+}
+
+BatchTrigger BatchPolicy::check(size_t queue_depth) const
+{
+    if (m_files == 0)
+    {
+        return BatchTrigger::None;
+    }
+    if (m_options.max_files > 0 && m_files >= m_options.max_files)
+    {
+        return BatchTrigger::Files;
+    }
+    if (m_options.max_bytes > 0 && m_bytes >= m_options.max_bytes)
+    {
+        return BatchTrigger::Bytes;
+    }
+    if (m_options.queue_watermark > 0 && queue_depth >= m_options.queue_watermark)
+    {
+        return BatchTrigger::Watermark;
+    }
+    if (m_options.max_wait.count() > 0 && std::chrono::steady_clock::now() - m_first_added >= m_options.max_wait)
+    {
+        return BatchTrigger::Wait;
+    }
+    return BatchTrigger::None;
+}
+
+void BatchPolicy::reset()
+{
+    m_files = 0;
+    m_bytes = 0;
+}
+
+size_t BatchPolicy::files() const
+{
+    return m_files;
+}
+
+uint64_t BatchPolicy::bytes() const
+{
+    return m_bytes;
+}
@@ -0,0 +1,92 @@
+#ifndef BATCH_POLICY_H
+#define BATCH_POLICY_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+const size_t BATCH_MAX_FILES = 10;
+
+/**
+ * Why a batch was handed to the sorter.
+ *
+ * Files:     it holds max_files files.
+ * Bytes:     its files take max_bytes or more.
+ * Wait:      its first file arrived max_wait ago.
+ * Watermark: queue_watermark or more files wait in the queue behind it.
+ */
+enum class BatchTrigger
+{
+    None,
+    Files,
+    Bytes,
+    Wait,
+    Watermark
+};
+
+inline std::string to_string(BatchTrigger trigger)
+{
+    switch (trigger)
+    {
+    case BatchTrigger::Files:
+        return "files";
+    case BatchTrigger::Bytes:
+        return "bytes";
+    case BatchTrigger::Wait:
+        return "wait";
+    case BatchTrigger::Watermark:
+        return "watermark";
+    case BatchTrigger::None:
+    default:
+        return "none";
+    }
+}
+
+/**
+ * Limits of a batch, 0 turns a limit off.
+ */
+struct BatchOptions
+{
+    size_t max_files = BATCH_MAX_FILES;
+    uint64_t max_bytes = 0;
+    std::chrono::milliseconds max_wait{0}; // since the first file of the batch arrived
+    size_t queue_watermark = 0;            // files waiting to be added to a batch
+};
+
+/**
+ * Decides when the files collected by the ingest loop are sorted as a batch. Size limits keep a burst of files from
+ * piling up into one huge batch, the wait limit keeps a slow trickle of files from waiting forever and the watermark
+ * flushes the batch early while the queue behind it grows, so the sorter keeps up.
+ */
+class BatchPolicy
+{
+private:
+    BatchOptions m_options;
+    size_t m_files = 0;
+    uint64_t m_bytes = 0;
+    std::chrono::steady_clock::time_point m_first_added;
+
+public:
+    BatchPolicy(const BatchOptions &options = BatchOptions());
+
+    /**
+     * Counts file_path, which was just added to the batch.
+     */
+    void add(const std::string &file_path);
+
+    /**
+     * The limit the batch reached, with queue_depth files waiting in the queue. None if it reached none or is empty.
+     */
+    BatchTrigger check(size_t queue_depth) const;
+
+    /**
+     * Starts over with an empty batch.
+     */
+    void reset();
+
+    size_t files() const;
+    uint64_t bytes() const;
+};
+
+#endif
@@ -0,0 +1,142 @@
+#include "BlockReader.h"
+
+#include <stdexcept>
+
+BlockReader::BlockReader(const std::string &file_path, size_t buffer_bytes, const Codec &codec, CodecStats *stats, AlignedBufferPool *direct_pool, IOBackend *io, ThreadPool *decode_pool) : m_file_path(file_path),
+                                                                                                                                                                                             m_source(file_path, buffer_bytes, direct_pool, 0, io),
+                                                                                                                                                                                             m_codec(codec),
+                                                                                                                                                                                             m_stats(stats),
+                                                                                                                                                                                             m_decode_pool(decode_pool)
+{
+    if (m_source.is_open())
+    {
+        request_block();
+    }
+}
+
+BlockReader::~BlockReader()
+{
+    try
+    {
+        close();
+    }
+    catch (...)
+    {
+        // Destructors must not throw
+    }
+}
+
+bool BlockReader::is_open() const
+{
+    return m_source.is_open();
+}
+
+void BlockReader::close()
+{
+    // The block being decoded still reads from the file, whatever it found doesn't matter anymore
+    if (m_next.valid())
+    {
+        m_next.wait();
+        m_next = std::future<bool>();
+    }
+    m_source.close();
+    setg(nullptr, nullptr, nullptr);
+}
+
+/**
+ * Starts decoding the next block into m_next_block on the decode pool, if there is one.
+ *
+ */
+void BlockReader::request_block()
+{
+    if (m_decode_pool != nullptr)
+    {
+        m_next = m_decode_pool->submit([this]()
+                                       { return read_block(m_next_block); });
+    }
+}
+
+/**
+ * Makes the next block the current one and starts on the one after it. Returns false at the end of the file,
+ * rethrows what reading the block threw.
+ *
+ */
+bool BlockReader::next_block()
+{
+    if (m_decode_pool == nullptr)
+    {
+        return read_block(m_block);
+    }
+
+    // Nothing requested: the end was reached, or reading failed before
+    if (!m_next.valid())
+    {
+        return false;
+    }
+    if (!m_next.get())
+    {
+        return false;
+    }
+    m_block.swap(m_next_block);
+    request_block();
+    return true;
+}
+
+/**
+ * Reads size bytes. Returns false if the file ends before the first byte and allow_eof is set.
+ *
+ */
+bool BlockReader::read_fully(char *data, size_t size, bool allow_eof)
+{
+    const std::streamsize n = m_source.sgetn(data, static_cast<std::streamsize>(size));
+    if (n == 0 && allow_eof)
+    {
+        return false;
+    }
+    if (n != static_cast<std::streamsize>(size))
+    {
+        throw std::runtime_error("Truncated block in '" + m_file_path + "'");
+    }
+    return true;
+}
+
+/**
+ * Reads and decompresses the next block. Returns false at the end of the file.
+ *
+ */
+bool BlockReader::read_block(std::string &block)
+{
+    BlockHeader header;
+    if (!read_fully(reinterpret_cast<char *>(&header), sizeof(header), true))
+    {
+        return false;
+    }
+    if (header.stored_size > header.raw_size)
+    {
+        throw std::runtime_error("Invalid block header in '" + m_file_path + "'");
+    }
+
+    m_stored.resize(header.stored_size);
+    read_fully(m_stored.data(), m_stored.size(), false);
+    decode_block(m_codec, header, m_stored.data(), block, m_stats);
+    return true;
+}
+
+BlockReader::int_type BlockReader::underflow()
+{
+    if (gptr() < egptr())
+    {
+        return traits_type::to_int_type(*gptr());
+    }
+
+    // Empty blocks are never written, but skip them anyway
+    while (next_block())
+    {
+        if (!m_block.empty())
+        {
+            setg(m_block.data(), m_block.data(), m_block.data() + m_block.size());
+            return traits_type::to_int_type(*gptr());
+        }
+    }
+    return traits_type::eof();
+}
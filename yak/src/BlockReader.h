@@ -0,0 +1,53 @@
+#ifndef BLOCK_READER_H
+#define BLOCK_READER_H
+
+#include "Codec.h"
+#include "ReadAheadReader.h"
+#include "ThreadPool.h"
+
+#include <future>
+#include <streambuf>
+#include <string>
+
+/**
+ * Stream buffer over a file of compressed blocks (see BlockHeader), as written by a BufferedWriter with a codec.
+ * The compressed bytes come through a ReadAheadReader, so the following blocks are already being read on the
+ * (shared) IOBackend while the current one is consumed. With a decode pool, the next block is also decompressed
+ * there while the current one is consumed, one block ahead per reader, and the reading thread only waits for it.
+ * Without one, blocks are decompressed on the reading thread. No threads of its own either way, so a wide merge
+ * doesn't start one per run.
+ *
+ * Corrupt or truncated files throw std::runtime_error from the reading call.
+ */
+class BlockReader : public std::streambuf
+{
+private:
+    std::string m_file_path;
+    ReadAheadReader m_source;
+    const Codec &m_codec;
+    CodecStats *m_stats;
+    ThreadPool *m_decode_pool;
+    std::string m_block;
+    std::string m_next_block;
+    std::string m_stored;
+    std::future<bool> m_next; // decoding m_next_block on the pool
+
+private:
+    void request_block();
+    bool next_block();
+    bool read_block(std::string &block);
+    bool read_fully(char *data, size_t size, bool allow_eof);
+
+protected:
+    int_type underflow() override;
+
+public:
+    BlockReader(const std::string &file_path, size_t buffer_bytes, const Codec &codec, CodecStats *stats, AlignedBufferPool *direct_pool = nullptr, IOBackend *io = nullptr, ThreadPool *decode_pool = nullptr);
+    ~BlockReader();
+    BlockReader(const BlockReader &) = delete;
+    BlockReader &operator=(const BlockReader &) = delete;
+    bool is_open() const;
+    void close();
+};
+
+#endif
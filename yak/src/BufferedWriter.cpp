@@ -0,0 +1,580 @@
+#include "BufferedWriter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+// How many full buffers may wait for the background writer before the caller has to wait
+const size_t MAX_PENDING_BUFFERS = 2;
+
+BufferedWriter::BufferedWriter(size_t buffer_bytes, FlushPolicy flush_policy, bool background) : m_fd(-1),
+                                                                                                  m_buffer_bytes(std::max<size_t>(buffer_bytes, 1)),
+                                                                                                  m_flush_policy(flush_policy),
+                                                                                                  m_background(background),
+                                                                                                  m_bytes_written(0),
+                                                                                                  m_file_offset(0),
+                                                                                                  m_codec(nullptr),
+                                                                                                  m_codec_stats(nullptr),
+                                                                                                  m_direct_pool(nullptr),
+                                                                                                  m_direct(false),
+                                                                                                  m_block_fill(0),
+                                                                                                  m_write_pending(false),
+                                                                                                  m_write_request(0),
+                                                                                                  m_write_offset(0),
+                                                                                                  m_write_data(nullptr),
+                                                                                                  m_write_size(0),
+                                                                                                  m_io(nullptr),
+                                                                                                  m_in_flight(0),
+                                                                                                  m_closing(false)
+{
+}
+
+BufferedWriter::BufferedWriter(const std::string &file_path, size_t buffer_bytes, FlushPolicy flush_policy, bool background) : BufferedWriter(buffer_bytes, flush_policy, background)
+{
+    open(file_path);
+}
+
+BufferedWriter::~BufferedWriter()
+{
+    try
+    {
+        close();
+    }
+    catch (...)
+    {
+        // Destructors must not throw, call close() to see write errors
+    }
+}
+
+/**
+ * Compress everything written from the next open() on with the codec (nullptr: don't compress).
+ *
+ */
+void BufferedWriter::set_codec(const Codec *codec, CodecStats *stats)
+{
+    if (is_open())
+    {
+        throw std::runtime_error("The codec of '" + m_file_path + "' can't change while it is open");
+    }
+    m_codec = codec;
+    m_codec_stats = stats;
+}
+
+/**
+ * Write files opened from now on with O_DIRECT through aligned blocks from the pool (nullptr: through the page cache).
+ *
+ */
+void BufferedWriter::set_direct_io(AlignedBufferPool *pool)
+{
+    if (is_open())
+    {
+        throw std::runtime_error("Direct I/O of '" + m_file_path + "' can't change while it is open");
+    }
+    m_direct_pool = pool;
+}
+
+/**
+ * Write files opened from now on through the backend, which may be shared with other streams (nullptr: through one
+ * of the writer's own).
+ *
+ */
+void BufferedWriter::set_io(IOBackend *io)
+{
+    if (is_open())
+    {
+        throw std::runtime_error("The I/O backend of '" + m_file_path + "' can't change while it is open");
+    }
+    if (io != nullptr)
+    {
+        m_own_io.reset();
+    }
+    m_io = io;
+}
+
+/**
+ * Creates (or truncates) the file. Returns false if it can't be opened, like std::ofstream::is_open() would.
+ *
+ */
+bool BufferedWriter::open(const std::string &file_path)
+{
+    close();
+
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    m_file_path = file_path;
+    m_direct = false;
+#ifdef O_DIRECT
+    if (m_direct_pool != nullptr)
+    {
+        // EINVAL: the file system can't do direct I/O
+        m_fd = ::open(file_path.c_str(), flags | O_DIRECT, 0644);
+        m_direct = m_fd >= 0;
+    }
+#endif
+    if (!m_direct)
+    {
+        m_fd = ::open(file_path.c_str(), flags, 0644);
+    }
+    if (m_fd < 0)
+    {
+        return false;
+    }
+
+    m_bytes_written = 0;
+    m_file_offset = 0;
+    m_buffer.reserve(m_buffer_bytes);
+    if (m_direct)
+    {
+        m_block = m_direct_pool->acquire(m_buffer_bytes);
+        m_block_spare = m_direct_pool->acquire(m_buffer_bytes);
+        m_block_fill = 0;
+    }
+    if ((!m_background || m_direct) && m_io == nullptr)
+    {
+        m_own_io = IOBackend::create();
+        m_io = m_own_io.get();
+    }
+    if (m_background)
+    {
+        m_closing = false;
+        m_error = nullptr;
+        m_thread = std::thread(&BufferedWriter::run, this);
+    }
+    return true;
+}
+
+bool BufferedWriter::is_open() const
+{
+    return m_fd >= 0;
+}
+
+void BufferedWriter::write(std::string_view data)
+{
+    m_bytes_written += data.size();
+    if (m_direct && !m_background && m_codec == nullptr)
+    {
+        // Nothing to do with the data on the way, it can go straight into the aligned blocks
+        stage(data.data(), data.size());
+        return;
+    }
+
+    if (m_buffer.size() + data.size() <= m_buffer_bytes)
+    {
+        m_buffer.append(data);
+        return;
+    }
+
+    if (!m_background && m_codec == nullptr && !m_direct && data.size() >= m_buffer_bytes)
+    {
+        // Too big to be worth buffering: buffer and data in one syscall, without copying the data
+        struct iovec iov[2] = {{m_buffer.data(), m_buffer.size()}, {const_cast<char *>(data.data()), data.size()}};
+        write_all(iov, 2);
+        m_buffer.clear();
+        return;
+    }
+
+    while (!data.empty())
+    {
+        size_t n = std::min(data.size(), m_buffer_bytes - m_buffer.size());
+        m_buffer.append(data.substr(0, n));
+        data.remove_prefix(n);
+        if (m_buffer.size() == m_buffer_bytes)
+        {
+            hand_off();
+        }
+    }
+}
+
+void BufferedWriter::write_line(std::string_view line)
+{
+    write(line);
+    write(std::string_view("\n", 1));
+    if (m_flush_policy == FlushPolicy::EveryLine)
+    {
+        flush();
+    }
+}
+
+/**
+ * Hands everything written so far to the OS and waits until it got there.
+ *
+ */
+void BufferedWriter::flush()
+{
+    hand_off();
+    if (m_background)
+    {
+        wait_idle();
+    }
+    else
+    {
+        wait_write();
+    }
+}
+
+void BufferedWriter::close()
+{
+    if (!is_open())
+    {
+        return;
+    }
+
+    std::exception_ptr error;
+    try
+    {
+        hand_off();
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    if (m_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closing = true;
+        }
+        m_cv.notify_all();
+        m_thread.join();
+
+        if (!error)
+        {
+            error = m_error;
+        }
+    }
+
+    // Also after an error, the last write still uses the descriptor
+    try
+    {
+        wait_write();
+        if (m_direct && !error)
+        {
+            finish_direct();
+        }
+    }
+    catch (...)
+    {
+        if (!error)
+        {
+            error = std::current_exception();
+        }
+    }
+
+    if (::close(m_fd) != 0 && !error)
+    {
+        error = std::make_exception_ptr(std::runtime_error("Unable to close '" + m_file_path + "': " + std::strerror(errno)));
+    }
+    m_fd = -1;
+    m_buffer.clear();
+    m_block = AlignedBuffer();
+    m_block_spare = AlignedBuffer();
+    m_block_fill = 0;
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+size_t BufferedWriter::bytes_written() const
+{
+    return m_bytes_written;
+}
+
+void BufferedWriter::write_all(struct iovec *iov, size_t count)
+{
+    while (count > 0)
+    {
+        ssize_t n = ::pwritev(m_fd, iov, static_cast<int>(std::min<size_t>(count, IOV_MAX)), static_cast<off_t>(m_file_offset));
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error("Unable to write '" + m_file_path + "': " + std::strerror(errno));
+        }
+
+        // Skip what went out completely and continue after a short write
+        size_t written = static_cast<size_t>(n);
+        m_file_offset += written;
+        while (count > 0 && written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0)
+        {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+/**
+ * Writes all buffers with one pwritev (or stages them for direct I/O), each one compressed into a block first if
+ * there is a codec.
+ *
+ */
+void BufferedWriter::write_buffers(std::vector<std::string> &buffers)
+{
+    thread_local std::vector<struct iovec> iov;
+    thread_local std::vector<std::string> frames;
+    if (m_direct)
+    {
+        for (auto &buffer : buffers)
+        {
+            if (m_codec != nullptr)
+            {
+                frames.resize(1);
+                encode_block(*m_codec, buffer.data(), buffer.size(), frames[0], m_codec_stats);
+                stage(frames[0].data(), frames[0].size());
+            }
+            else
+            {
+                stage(buffer.data(), buffer.size());
+            }
+        }
+        return;
+    }
+
+    iov.clear();
+    if (m_codec == nullptr)
+    {
+        for (auto &buffer : buffers)
+        {
+            iov.push_back({buffer.data(), buffer.size()});
+        }
+    }
+    else
+    {
+        frames.resize(std::max(frames.size(), buffers.size()));
+        for (size_t i = 0; i < buffers.size(); ++i)
+        {
+            encode_block(*m_codec, buffers[i].data(), buffers[i].size(), frames[i], m_codec_stats);
+            iov.push_back({frames[i].data(), frames[i].size()});
+        }
+    }
+    write_all(iov.data(), iov.size());
+}
+
+/**
+ * Writes the buffer, or queues it for the background writer and continues with a free one.
+ *
+ */
+void BufferedWriter::hand_off()
+{
+    if (m_buffer.empty())
+    {
+        return;
+    }
+
+    if (!m_background && m_direct)
+    {
+        // Staging copies, so both buffers are free again right away
+        if (m_codec != nullptr)
+        {
+            encode_block(*m_codec, m_buffer.data(), m_buffer.size(), m_spare, m_codec_stats);
+            stage(m_spare.data(), m_spare.size());
+        }
+        else
+        {
+            stage(m_buffer.data(), m_buffer.size());
+        }
+        m_buffer.clear();
+        return;
+    }
+
+    if (!m_background)
+    {
+        // The other buffer is free again once its write is done
+        wait_write();
+        if (m_codec != nullptr)
+        {
+            encode_block(*m_codec, m_buffer.data(), m_buffer.size(), m_spare, m_codec_stats);
+        }
+        else
+        {
+            m_buffer.swap(m_spare);
+        }
+        m_buffer.clear();
+        m_buffer.reserve(m_buffer_bytes);
+        submit_write(m_spare.data(), m_spare.size());
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]()
+                  { return m_pending.size() < MAX_PENDING_BUFFERS || m_error; });
+        if (m_error)
+        {
+            std::rethrow_exception(m_error);
+        }
+
+        m_pending.push_back(std::move(m_buffer));
+        if (!m_free.empty())
+        {
+            m_buffer = std::move(m_free.back());
+            m_free.pop_back();
+        }
+        else
+        {
+            m_buffer = std::string();
+            m_buffer.reserve(m_buffer_bytes);
+        }
+    }
+    m_cv.notify_all();
+}
+
+void BufferedWriter::submit_write(const char *data, size_t size)
+{
+    m_write_offset = m_file_offset;
+    m_write_data = data;
+    m_write_size = size;
+    m_write_request = m_io->submit_write(m_fd, data, size, m_write_offset);
+    m_write_pending = true;
+    m_file_offset += size;
+}
+
+/**
+ * Waits for the asynchronous write of the spare buffer. Whatever a short write left over is written right away.
+ *
+ */
+void BufferedWriter::wait_write()
+{
+    if (!m_write_pending)
+    {
+        return;
+    }
+
+    m_write_pending = false;
+    int64_t n = m_io->wait(m_write_request);
+    if (n < 0)
+    {
+        throw std::runtime_error("Unable to write '" + m_file_path + "': " + std::strerror(static_cast<int>(-n)));
+    }
+
+    size_t written = static_cast<size_t>(n);
+    while (written < m_write_size)
+    {
+        ssize_t more = ::pwrite(m_fd, m_write_data + written, m_write_size - written, static_cast<off_t>(m_write_offset + written));
+        if (more < 0 && errno != EINTR)
+        {
+            throw std::runtime_error("Unable to write '" + m_file_path + "': " + std::strerror(errno));
+        }
+        written += static_cast<size_t>(std::max<ssize_t>(more, 0));
+    }
+}
+
+/**
+ * Copies the data into the aligned block and writes every block that gets full while the next one is filled.
+ *
+ */
+void BufferedWriter::stage(const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        size_t n = std::min(size, m_block.size() - m_block_fill);
+        std::memcpy(m_block.data() + m_block_fill, data, n);
+        m_block_fill += n;
+        data += n;
+        size -= n;
+
+        if (m_block_fill == m_block.size())
+        {
+            wait_write();
+            std::swap(m_block, m_block_spare);
+            m_block_fill = 0;
+            submit_write(m_block_spare.data(), m_block_spare.size());
+        }
+    }
+}
+
+/**
+ * Writes the partial last block. O_DIRECT can only write whole blocks, so the descriptor drops it for the tail.
+ *
+ */
+void BufferedWriter::finish_direct()
+{
+    if (m_block_fill == 0)
+    {
+        return;
+    }
+
+#ifdef O_DIRECT
+    int flags = fcntl(m_fd, F_GETFL);
+    if (flags < 0 || fcntl(m_fd, F_SETFL, flags & ~O_DIRECT) != 0)
+    {
+        throw std::runtime_error("Unable to write '" + m_file_path + "': " + std::strerror(errno));
+    }
+#endif
+    struct iovec iov = {m_block.data(), m_block_fill};
+    write_all(&iov, 1);
+    m_block_fill = 0;
+}
+
+void BufferedWriter::wait_idle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]()
+              { return (m_pending.empty() && m_in_flight == 0) || m_error; });
+    if (m_error)
+    {
+        std::rethrow_exception(m_error);
+    }
+}
+
+void BufferedWriter::run()
+{
+    std::vector<std::string> batch;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this]()
+                      { return !m_pending.empty() || m_closing; });
+
+            // Drain before stopping
+            if (m_pending.empty())
+            {
+                return;
+            }
+
+            batch.swap(m_pending);
+            m_in_flight = batch.size();
+        }
+        m_cv.notify_all();
+
+        std::exception_ptr error;
+        try
+        {
+            write_buffers(batch);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (error && !m_error)
+            {
+                m_error = error;
+            }
+            for (auto &buffer : batch)
+            {
+                buffer.clear();
+                m_free.push_back(std::move(buffer));
+            }
+            batch.clear();
+            m_in_flight = 0;
+        }
+        m_cv.notify_all();
+    }
+}
@@ -0,0 +1,124 @@
+#ifndef BUFFERED_WRITER_H
+#define BUFFERED_WRITER_H
+
+#include "AlignedBuffer.h"
+#include "Codec.h"
+#include "IOBackend.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <thread>
+#include <vector>
+
+const size_t WRITE_BUFFER_BYTES = 1024 * 1024;
+
+/**
+ * When buffered output is handed to the OS.
+ *
+ * WhenFull: only when the buffer is full, on flush() and on close().
+ * EveryLine: after every write_line(), for output somebody watches while it is written.
+ */
+enum class FlushPolicy
+{
+    WhenFull,
+    EveryLine
+};
+
+/**
+ * Output file written through one large reusable buffer instead of a syscall per row.
+ *
+ * Full buffers are double buffered: one is written through an IOBackend while the caller fills the other. Only data
+ * at least as big as the whole buffer goes out right away, together with the buffer in a single pwritev(2).
+ * The backend may be shared with other streams (see set_io()), otherwise the writer sets up one of its own.
+ * With a background writer, full buffers are handed to a thread that writes everything queued up so far with one
+ * pwritev(2) while the caller keeps filling the next buffer; the caller only waits if the writer falls more than a
+ * couple of buffers behind. Write errors are thrown as std::runtime_error from the writing call, or from the next
+ * call on the caller's side when they happen in the background.
+ *
+ * With a codec set, every buffer is written as one compressed block (see BlockHeader), compressed by whichever
+ * thread writes it: the background writer if there is one.
+ *
+ * With direct I/O the file is written with O_DIRECT, bypassing the page cache: output is staged in aligned blocks
+ * from the given pool and only whole blocks are written (double buffered, like above), so flush() leaves a partial
+ * block behind. The unaligned tail goes through the page cache on close(). File systems without O_DIRECT are
+ * written through the page cache.
+ */
+class BufferedWriter
+{
+private:
+    std::string m_file_path;
+    int m_fd;
+    size_t m_buffer_bytes;
+    FlushPolicy m_flush_policy;
+    bool m_background;
+    std::string m_buffer;
+    size_t m_bytes_written;
+    uint64_t m_file_offset;
+    const Codec *m_codec;
+    CodecStats *m_codec_stats;
+
+    // Direct I/O
+    AlignedBufferPool *m_direct_pool;
+    bool m_direct;
+    AlignedBuffer m_block;
+    AlignedBuffer m_block_spare;
+    size_t m_block_fill;
+
+    // Asynchronous write of the other buffer, if there is no background writer (or for direct I/O)
+    std::string m_spare;
+    bool m_write_pending;
+    uint64_t m_write_request;
+    uint64_t m_write_offset;
+    const char *m_write_data;
+    size_t m_write_size;
+    std::unique_ptr<IOBackend> m_own_io;
+    IOBackend *m_io;
+
+    // Background writer
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<std::string> m_pending;
+    std::vector<std::string> m_free;
+    size_t m_in_flight;
+    bool m_closing;
+    std::exception_ptr m_error;
+
+private:
+    void write_all(struct iovec *iov, size_t count);
+    void write_buffers(std::vector<std::string> &buffers);
+    void hand_off();
+    void submit_write(const char *data, size_t size);
+    void wait_write();
+    void stage(const char *data, size_t size);
+    void finish_direct();
+    void wait_idle();
+    void run();
+
+public:
+    BufferedWriter(size_t buffer_bytes = WRITE_BUFFER_BYTES, FlushPolicy flush_policy = FlushPolicy::WhenFull, bool background = false);
+    BufferedWriter(const std::string &file_path, size_t buffer_bytes = WRITE_BUFFER_BYTES, FlushPolicy flush_policy = FlushPolicy::WhenFull, bool background = false);
+    ~BufferedWriter();
+
+    BufferedWriter(const BufferedWriter &) = delete;
+    BufferedWriter &operator=(const BufferedWriter &) = delete;
+
+    void set_codec(const Codec *codec, CodecStats *stats);
+    void set_direct_io(AlignedBufferPool *pool);
+    void set_io(IOBackend *io);
+    bool open(const std::string &file_path);
+    bool is_open() const;
+    void write(std::string_view data);
+    void write_line(std::string_view line);
+    void flush();
+    void close();
+    size_t bytes_written() const;
+};
+
+#endif
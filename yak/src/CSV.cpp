@@ -1,7 +1,10 @@
 #include "CSV.h"
+#include "MappedLineReader.h"
+#include "ParallelSort.h"
+#include "RunFormat.h"
 #include "Util.h"
-#include <fstream>
 #include <algorithm>
+#include <limits>
 
 CSV::CSV()
 {
@@ -12,205 +15,234 @@ CSV::CSV(std::string file_path)
     load(file_path);
 }
 
-std::vector<std::string> CSV::read_row(const std::string &row)
+/**
+ * Loads the file and builds the sort key of every row for the given columns while reading it, so a later sort by
+ * the same columns doesn't have to look at the fields again.
+ *
+ */
+CSV::CSV(std::string file_path, const std::vector<std::string> &key_columns) : m_key_columns(key_columns)
 {
-    CSVState state = CSVState::UnquotedField;
-    std::vector<std::string> fields{""};
-    size_t i = 0; // index of the current field
-    for (char c : row)
+    load(file_path);
+}
+
+/**
+ * Takes over rows that were already parsed elsewhere (e.g. by the splitter), including their sort keys.
+ *
+ */
+CSV::CSV(const std::vector<std::string> &header, RowTable &&table) : m_header(header), m_table(std::move(table))
+{
+}
+
+std::vector<std::string> CSV::read_row(std::string_view row)
+{
+    RowTable table;
+    table.append(row);
+
+    std::vector<std::string> fields;
+    Row r = table[0];
+    for (size_t i = 0; i < r.size(); ++i)
     {
-        switch (state)
-        {
-        case CSVState::UnquotedField:
-            switch (c)
-            {
-            case ',': // end of field
-                fields.push_back("");
-                i++;
-                break;
-            case '"':
-                state = CSVState::QuotedField;
-                break;
-            default:
-                fields[i].push_back(c);
-                break;
-            }
-            break;
-        case CSVState::QuotedField:
-            switch (c)
-            {
-            case '"':
-                state = CSVState::QuotedQuote;
-                break;
-            default:
-                fields[i].push_back(c);
-                break;
-            }
-            break;
-        case CSVState::QuotedQuote:
-            switch (c)
-            {
-            case ',': // , after closing quote
-                fields.push_back("");
-                i++;
-                state = CSVState::UnquotedField;
-                break;
-            case '"': // "" -> "
-                fields[i].push_back('"');
-                state = CSVState::QuotedField;
-                break;
-            default: // end of quote
-                state = CSVState::UnquotedField;
-                break;
-            }
-            break;
-        }
+        fields.emplace_back(r[i]);
     }
     return fields;
 }
 
 void CSV::load(const std::string &file_path)
 {
-    std::ifstream file(file_path);
-    read_csv(file);
-    file.close();
+    MappedLineReader in(file_path);
+    read_csv(in);
 }
 
 std::vector<std::string> CSV::read_header(const std::string &file_path)
 {
-    std::ifstream in(file_path);
+    MappedLineReader in(file_path);
     std::vector<std::string> header;
-    if (!in.eof())
+    std::string_view line;
+    if (in.next(line))
     {
-        std::string line;
-        std::getline(in, line);
         header = CSV::read_row(line);
     }
-    in.close();
     return header;
 }
 
-Row CSV::convert_to_row(const std::string &line, const std::vector<std::string> &columns)
+/**
+ * Parses a single line into the (cleared) table and returns a view on it. Reusing the same table for every call
+ * avoids allocating once the arena has grown to the size of the longest line.
+ *
+ */
+Row CSV::convert_to_row(std::string_view line, RowTable &table)
 {
-    auto fields = CSV::read_row(line);
-    Row row;
-    for (size_t i = 0; i < fields.size(); ++i)
+    table.clear();
+    table.append(line);
+    return table[0];
+}
+
+/**
+ * Resolves column names to their position in the header. Unknown columns map to an index no row has.
+ *
+ */
+std::vector<size_t> CSV::column_indices(const std::vector<std::string> &header, const std::vector<std::string> &columns)
+{
+    std::vector<size_t> indices;
+    for (const auto &c : columns)
     {
-        row[columns[i]] = fields[i];
+        auto it = std::find(header.begin(), header.end(), c);
+        indices.push_back(it == header.end() ? std::numeric_limits<size_t>::max() : static_cast<size_t>(it - header.begin()));
     }
-
-    return row;
+    return indices;
 }
 
-void CSV::read_csv(std::istream &in)
+void CSV::write_header(BufferedWriter &out, const std::vector<std::string> &header)
 {
-    bool first_line = true;
     std::string line;
-    while (!in.eof())
+    std::string sep = "";
+    for (const auto &c : header)
     {
-        std::getline(in, line);
-        if (in.bad() || in.fail())
-        {
-            break;
-        }
+        line.append(sep).append(c);
+        sep.assign(",");
+    }
+    out.write_line(line);
+}
 
-        if (first_line)
+/**
+ * Writes the first num_columns fields of the row as a line, see append_row.
+ *
+ */
+void CSV::write_row(BufferedWriter &out, const Row &row, size_t num_columns)
+{
+    thread_local std::string line;
+    line.clear();
+    append_row(line, row, num_columns);
+    out.write_line(line);
+}
+
+/**
+ * Renders the first num_columns fields of the row, each one quoted (quotes inside a field are doubled, so read_row
+ * gives back the same fields). Missing fields are rendered as empty.
+ *
+ */
+void CSV::append_row(std::string &out, const Row &row, size_t num_columns)
+{
+    for (size_t i = 0; i < num_columns; ++i)
+    {
+        if (i > 0)
         {
-            m_header = CSV::read_row(line);
-            first_line = false;
+            out.push_back(',');
         }
-        else
+        out.push_back('"');
+        std::string_view field = row.has(i) ? row[i] : std::string_view();
+        for (char c : field)
         {
-            Row row = CSV::convert_to_row(line, m_header);
-            m_table.push_back(row);
+            out.push_back(c);
+            if (c == '"')
+            {
+                out.push_back('"');
+            }
         }
+        out.push_back('"');
     }
 }
 
-bool is_smaller(const Row &ra, const Row &rb, const std::vector<std::string> &attr, size_t i)
+/**
+ * Reads header and rows from the file. The file size is used to size the table up front: unquoting only ever
+ * shrinks a line, so it bounds the arena, and the first row gives an estimate for the row count.
+ *
+ */
+void CSV::read_csv(MappedLineReader &in)
 {
-    if (i == attr.size())
-    {
-        return false;
-    }
-
-    if (ra.size() == 0 || ra.find(attr[i]) == ra.end())
-    {
-        return true; // Consider an empty row to be "smaller"
-                     // than any non-empty vector.
-    }
-
-    if (rb.size() == 0 || rb.find(attr[i]) == rb.end())
-    {
-        return false; // If right side is empty, left can only be equal or larger
-    }
-
-    bool equal;
-    if (Util::is_number(ra.at(attr[i])) && Util::is_number(rb.at(attr[i])))
-    {
-        equal = stod(ra.at(attr[i])) == stod(rb.at(attr[i]));
-    }
-    else
+    const size_t size_hint = in.size();
+    bool first_line = true;
+    std::string_view line;
+    while (in.next(line))
     {
-        equal = ra.at(attr[i]).compare(rb.at(attr[i])) == 0;
-    }
 
-    if (equal)
-    {
-        return is_smaller(ra, rb, attr, i + 1);
-    }
-    else
-    {
-        if (Util::is_number(ra.at(attr[i])) && Util::is_number(rb.at(attr[i])))
+        if (first_line)
         {
-            return stod(ra.at(attr[i])) < stod(rb.at(attr[i]));
+            m_header = CSV::read_row(line);
+            if (!m_key_columns.empty())
+            {
+                m_table.set_key_columns(CSV::column_indices(m_header, m_key_columns));
+            }
+            first_line = false;
         }
         else
         {
-            return ra.at(attr[i]).compare(rb.at(attr[i])) < 0;
+            m_table.append(line);
+            if (m_table.size() == 1 && size_hint > 0)
+            {
+                m_table.reserve(size_hint, size_hint / (line.size() + 1) + 1, m_table[0].size());
+            }
         }
     }
 }
 
-void CSV::sort_in_memory(const std::vector<std::string> &attr)
+/**
+ * Sorts the rows by the given columns, spreading the sort over the idle workers of pool if there is one.
+ *
+ */
+void CSV::sort_in_memory(const std::vector<std::string> &attr, ThreadPool *pool)
 {
-    std::sort(m_table.begin(), m_table.end(),
-              [&attr](const Row &ra, const Row &rb) -> bool
-              {
-                  return is_smaller(ra, rb, attr, 0);
-              });
+    // No-op if the keys were already built for these columns on load
+    m_table.set_key_columns(CSV::column_indices(m_header, attr));
+    ParallelSort::sort(m_table, pool);
 }
 
 bool CSV::sort_in_memory_and_write(const std::vector<std::string> &attr, const std::string &file_path)
 {
     sort_in_memory(attr);
 
-    std::string sep = "";
-    std::ofstream file(file_path);
+    BufferedWriter file(file_path);
 
     if (file.is_open())
     {
-        // Write header
-        for (const auto &c : m_header)
+        write_header(file, m_header);
+        for (const auto &row : *this)
         {
-            file << sep << c;
-            sep.assign(",");
+            write_row(file, row, m_header.size());
         }
-        file << std::endl;
 
-        // Write rows
-        for (const auto &row : m_table)
+        file.close();
+    }
+    else
+    {
+        std::cerr << "Unable to open file '" << file_path << "'";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Like sort_in_memory_and_write, but writes a sorted run (see RunFormat.h) with the sort keys that were built for
+ * sorting, the way the spill options say.
+ *
+ */
+bool CSV::sort_in_memory_and_write_run(const std::vector<std::string> &attr, const std::string &file_path, const SpillOptions &spill, ThreadPool *pool)
+{
+    sort_in_memory(attr, pool);
+
+    BufferedWriter file;
+    file.set_codec(spill.codec, spill.codec_stats);
+    file.set_direct_io(spill.buffer_pool);
+    file.set_io(spill.io);
+    file.open(file_path);
+
+    if (file.is_open())
+    {
+        std::string record;
+        RunIndex index;
+        for (const auto &ref : m_table.rows())
         {
-            sep.assign("");
-            for (const auto &c : m_header)
-            {
-                file << sep << "\"" << row.at(c) << "\"";
-                sep.assign(",");
-            }
-            file << std::endl;
+            record.clear();
+            RunFormat::append_record(record, m_table.key(ref), m_table.row(ref), m_header.size());
+            file.write(record);
+            index.add(m_table.key(ref), record.size());
         }
 
         file.close();
+        if (spill.run_indexes != nullptr)
+        {
+            spill.run_indexes->put(file_path, std::move(index));
+        }
     }
     else
     {
@@ -223,35 +255,47 @@ bool CSV::sort_in_memory_and_write(const std::vector<std::string> &attr, const s
 void CSV::resample_in_memory(size_t minutes)
 {
     sort_in_memory({"id", "timestamp"});
-    std::vector<Row> table;
+    if (m_table.empty())
+    {
+        return;
+    }
+
+    std::vector<size_t> columns = CSV::column_indices(m_header, {"id", "timestamp"});
+    const size_t id_column = columns[0];
+    const size_t timestamp_column = columns[1];
+
+    // Only the row references get filtered; the arena stays as it is
+    std::vector<RowRef> rows;
 
-    std::string current_id = m_table[0].at("id");
-    long current_timestamp = stol(m_table[0].at("timestamp"));
-    table.push_back(m_table[0]);
+    Row first = m_table[0];
+    std::string_view current_id = first.at(id_column);
+    long current_timestamp = stol(std::string(first.at(timestamp_column)));
+    rows.push_back(m_table.rows()[0]);
 
-    for (const auto &row : m_table)
+    for (const auto &ref : m_table.rows())
     {
-        std::string id = row.at("id");
-        long timestamp = stol(row.at("timestamp"));
+        Row row = m_table.row(ref);
+        std::string_view id = row.at(id_column);
+        long timestamp = stol(std::string(row.at(timestamp_column)));
         if (id.compare(current_id) != 0)
         {
             // New ID
-            table.push_back(row);
+            rows.push_back(ref);
             current_id = id;
             current_timestamp = timestamp;
         }
         else
         {
-            if (timestamp > current_timestamp + minutes)
+            if (timestamp > current_timestamp + static_cast<long>(minutes))
             {
-                table.push_back(row);
+                rows.push_back(ref);
                 current_id = id;
                 current_timestamp = timestamp;
             }
         }
     }
 
-    m_table = std::move(table);
+    m_table.rows() = std::move(rows);
 }
 
 size_t CSV::size()
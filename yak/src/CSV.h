@@ -1,45 +1,51 @@
 #ifndef CSV_H
 #define CSV_H
 
+#include "BufferedWriter.h"
 #include "CSVDefinitions.h"
 #include "CSVIterator.h"
+#include "MappedLineReader.h"
+#include "RowTable.h"
+#include "SpillOptions.h"
+#include "ThreadPool.h"
 
-#include <istream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 
-enum class CSVState
-{
-    UnquotedField,
-    QuotedField,
-    QuotedQuote
-};
-
 class CSV
 {
 
 private:
     std::vector<std::string> m_header;
-    std::vector<Row> m_table;
+    std::vector<std::string> m_key_columns;
+    RowTable m_table;
 
 private:
-    void read_csv(std::istream &in);
-    void sort_in_memory(const std::vector<std::string> &attr);
+    void read_csv(MappedLineReader &in);
+    void sort_in_memory(const std::vector<std::string> &attr, ThreadPool *pool = nullptr);
 
 public:
     CSV();
     CSV(std::string file_path);
+    CSV(std::string file_path, const std::vector<std::string> &key_columns);
+    CSV(const std::vector<std::string> &header, RowTable &&table);
     void load(const std::string &file_path);
     size_t size();
     void resample_in_memory(size_t minutes);
     bool sort_in_memory_and_write(const std::vector<std::string> &attr, const std::string &file_path);
+    bool sort_in_memory_and_write_run(const std::vector<std::string> &attr, const std::string &file_path, const SpillOptions &spill = SpillOptions(), ThreadPool *pool = nullptr);
     static std::vector<std::string> read_header(const std::string &file_path);
-    static std::vector<std::string> read_row(const std::string &row);
-    static Row convert_to_row(const std::string &line, const std::vector<std::string> &columns);
-
-    CSVIterator begin() { return CSVIterator(m_table.begin()); }
-    CSVIterator end() { return CSVIterator(m_table.end()); }
+    static std::vector<std::string> read_row(std::string_view row);
+    static Row convert_to_row(std::string_view line, RowTable &table);
+    static void write_header(BufferedWriter &out, const std::vector<std::string> &header);
+    static void write_row(BufferedWriter &out, const Row &row, size_t num_columns);
+    static void append_row(std::string &out, const Row &row, size_t num_columns);
+    static std::vector<size_t> column_indices(const std::vector<std::string> &header, const std::vector<std::string> &columns);
+
+    CSVIterator begin() { return CSVIterator(&m_table, m_table.rows().cbegin()); }
+    CSVIterator end() { return CSVIterator(&m_table, m_table.rows().cend()); }
 };
 
-#endif
\ No newline at end of file
+#endif
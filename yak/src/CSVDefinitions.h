@@ -1,9 +1,72 @@
 #ifndef CSV_DEFINITIONS_H
 #define CSV_DEFINITIONS_H
 
-#include <map>
+#include <cstdint>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 
-using Row = std::map<std::string, std::string>;
+enum class CSVState
+{
+    UnquotedField,
+    QuotedField,
+    QuotedQuote
+};
 
-#endif
\ No newline at end of file
+/**
+ * Position of a single field inside the byte arena of a RowTable.
+ */
+struct FieldRef
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+/**
+ * Position of a row's fields inside the field index of a RowTable, plus its sort key (see SortKey.h) inside the
+ * key arena. The first 8 key bytes are kept inline so most comparisons never touch the arena.
+ */
+struct RowRef
+{
+    uint32_t first_field;
+    uint32_t field_count;
+    uint32_t key_offset;
+    uint32_t key_length;
+    uint64_t key_prefix;
+};
+
+/**
+ * Non-owning view on a single row of a RowTable. Columns are looked up by index. The view is only valid as long
+ * as the table it was taken from is neither modified nor destroyed.
+ */
+class Row
+{
+private:
+    const char *m_bytes;
+    const FieldRef *m_fields;
+    size_t m_size;
+
+public:
+    Row() : m_bytes(nullptr), m_fields(nullptr), m_size(0) {}
+    Row(const char *bytes, const FieldRef *fields, size_t size) : m_bytes(bytes), m_fields(fields), m_size(size) {}
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    bool has(size_t column) const { return column < m_size; }
+
+    std::string_view operator[](size_t column) const
+    {
+        return std::string_view(m_bytes + m_fields[column].offset, m_fields[column].length);
+    }
+
+    std::string_view at(size_t column) const
+    {
+        if (column >= m_size)
+        {
+            throw std::out_of_range("Row has no column " + std::to_string(column));
+        }
+        return (*this)[column];
+    }
+};
+
+#endif
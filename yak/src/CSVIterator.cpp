@@ -1,6 +1,6 @@
 #include "CSVIterator.h"
 
-CSVIterator::CSVIterator(std::vector<Row>::iterator it) : m_it(it)
+CSVIterator::CSVIterator(const RowTable *table, std::vector<RowRef>::const_iterator it) : m_table(table), m_it(it)
 {
 }
 
@@ -19,14 +19,15 @@ CSVIterator CSVIterator::operator++(int)
     return tmp;
 }
 
-const Row &CSVIterator::operator*() const
+Row CSVIterator::operator*() const
 {
-    return *m_it;
+    return m_table->row(*m_it);
 }
 
 const Row *CSVIterator::operator->() const
 {
-    return &(*m_it);
+    m_current = m_table->row(*m_it);
+    return &m_current;
 }
 
 bool CSVIterator::operator==(CSVIterator const &rhs) const
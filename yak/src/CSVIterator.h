@@ -2,6 +2,7 @@
 #define CSV_ITERATOR_H
 
 #include "CSVDefinitions.h"
+#include "RowTable.h"
 
 #include <iostream>
 #include <vector>
@@ -12,10 +13,10 @@ public:
     using iterator_category = std::forward_iterator_tag;
     using difference_type = std::ptrdiff_t;
     using value_type = Row;
-    using pointer = Row *;
-    using reference = Row &; // or also value_type&
+    using pointer = const Row *;
+    using reference = Row; // rows are views, so dereferencing yields a value
 
-    CSVIterator(std::vector<Row>::iterator it);
+    CSVIterator(const RowTable *table, std::vector<RowRef>::const_iterator it);
 
     // Pre Increment
     CSVIterator &operator++();
@@ -23,14 +24,16 @@ public:
     // Post Increment
     CSVIterator operator++(int);
 
-    Row const &operator*() const;
+    Row operator*() const;
     Row const *operator->() const;
 
     bool operator==(CSVIterator const &rhs) const;
     bool operator!=(CSVIterator const &rhs) const;
 
 private:
-    std::vector<Row>::iterator m_it;
+    const RowTable *m_table;
+    std::vector<RowRef>::const_iterator m_it;
+    mutable Row m_current;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,276 @@
+#include "CSVTokenizer.h"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CSV_TOKENIZER_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    const size_t BLOCK_BYTES = 32;
+
+    // Bit i set if byte i of the 32 byte block is a structural character
+    using MaskFunction = uint32_t (*)(const char *block);
+
+#ifdef CSV_TOKENIZER_X86
+    __attribute__((target("sse4.2"))) uint32_t structural_mask_sse42(const char *block)
+    {
+        const __m128i structural = _mm_setr_epi8(',', '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        const int mode = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK;
+
+        // Explicit lengths, so a NUL byte in the data doesn't end the comparison
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16));
+        uint32_t mask_lo = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_cmpestrm(structural, 2, lo, 16, mode))) & 0xFFFF;
+        uint32_t mask_hi = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_cmpestrm(structural, 2, hi, 16, mode))) & 0xFFFF;
+        return mask_lo | (mask_hi << 16);
+    }
+
+    __attribute__((target("avx2"))) uint32_t structural_mask_avx2(const char *block)
+    {
+        const __m256i comma = _mm256_set1_epi8(',');
+        const __m256i quote = _mm256_set1_epi8('"');
+
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block));
+        __m256i structural = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, comma), _mm256_cmpeq_epi8(bytes, quote));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(structural));
+    }
+#endif
+
+    MaskFunction mask_function(CSVTokenizer::Implementation implementation)
+    {
+        switch (implementation)
+        {
+#ifdef CSV_TOKENIZER_X86
+        case CSVTokenizer::Implementation::AVX2:
+            return structural_mask_avx2;
+        case CSVTokenizer::Implementation::SSE42:
+            return structural_mask_sse42;
+#endif
+        default:
+            return nullptr;
+        }
+    }
+
+    size_t tokenize_with(std::string_view line, std::string &bytes, std::vector<FieldRef> &fields, MaskFunction structural_mask)
+    {
+        const char *data = line.data();
+        const size_t n = line.size();
+
+        CSVState state = CSVState::UnquotedField;
+        size_t field_count = 1;
+        size_t copy_from = 0; // start of the field bytes not yet appended
+        size_t closing_quote = 0;
+        fields.push_back(FieldRef{static_cast<uint32_t>(bytes.size()), 0});
+
+        // Full blocks go through the kernel, what is left character by character
+        const size_t blocks_end = structural_mask != nullptr ? n / BLOCK_BYTES * BLOCK_BYTES : 0;
+
+        // Unquoting never makes the blocks longer: make room once and copy through a plain pointer
+        const size_t base = bytes.size();
+        if (blocks_end > 0)
+        {
+            bytes.resize(base + blocks_end);
+        }
+        char *out = bytes.data() + base;
+        size_t written = 0;
+
+        auto append_until = [&](size_t end)
+        {
+            if (end > copy_from)
+            {
+                std::memcpy(out + written, data + copy_from, end - copy_from);
+                written += end - copy_from;
+                fields.back().length += static_cast<uint32_t>(end - copy_from);
+            }
+        };
+
+        auto new_field = [&](size_t offset)
+        {
+            fields.push_back(FieldRef{static_cast<uint32_t>(offset), 0});
+            field_count++;
+        };
+
+        for (size_t block = 0; block < blocks_end; block += BLOCK_BYTES)
+        {
+            uint32_t mask = structural_mask(data + block);
+            while (mask != 0)
+            {
+                const size_t i = block + static_cast<size_t>(__builtin_ctz(mask));
+                mask &= mask - 1;
+                const char c = data[i];
+
+                if (state == CSVState::QuotedQuote)
+                {
+                    if (i == closing_quote + 1)
+                    {
+                        if (c == ',') // , after closing quote
+                        {
+                            new_field(base + written);
+                            state = CSVState::UnquotedField;
+                        }
+                        else // "" -> "
+                        {
+                            out[written++] = '"';
+                            fields.back().length++;
+                            state = CSVState::QuotedField;
+                        }
+                        copy_from = i + 1;
+                        continue;
+                    }
+
+                    // The character after the closing quote was no structural one: it is dropped and the field
+                    // continues unquoted
+                    state = CSVState::UnquotedField;
+                    copy_from = closing_quote + 2;
+                }
+
+                if (state == CSVState::UnquotedField)
+                {
+                    append_until(i);
+                    if (c == ',') // end of field
+                    {
+                        new_field(base + written);
+                    }
+                    else
+                    {
+                        state = CSVState::QuotedField;
+                    }
+                    copy_from = i + 1;
+                }
+                else if (c == '"') // QuotedField, delimiters are data
+                {
+                    append_until(i);
+                    state = CSVState::QuotedQuote;
+                    closing_quote = i;
+                }
+            }
+        }
+
+        if (state == CSVState::QuotedQuote && closing_quote + 1 < blocks_end)
+        {
+            state = CSVState::UnquotedField;
+            copy_from = closing_quote + 2;
+        }
+        if (state != CSVState::QuotedQuote)
+        {
+            append_until(blocks_end);
+        }
+        bytes.resize(base + written);
+
+        for (size_t i = blocks_end; i < n; ++i)
+        {
+            const char c = data[i];
+            switch (state)
+            {
+            case CSVState::UnquotedField:
+                switch (c)
+                {
+                case ',': // end of field
+                    new_field(bytes.size());
+                    break;
+                case '"':
+                    state = CSVState::QuotedField;
+                    break;
+                default:
+                    bytes.push_back(c);
+                    fields.back().length++;
+                    break;
+                }
+                break;
+            case CSVState::QuotedField:
+                switch (c)
+                {
+                case '"':
+                    state = CSVState::QuotedQuote;
+                    break;
+                default:
+                    bytes.push_back(c);
+                    fields.back().length++;
+                    break;
+                }
+                break;
+            case CSVState::QuotedQuote:
+                switch (c)
+                {
+                case ',': // , after closing quote
+                    new_field(bytes.size());
+                    state = CSVState::UnquotedField;
+                    break;
+                case '"': // "" -> "
+                    bytes.push_back('"');
+                    fields.back().length++;
+                    state = CSVState::QuotedField;
+                    break;
+                default: // end of quote
+                    state = CSVState::UnquotedField;
+                    break;
+                }
+                break;
+            }
+        }
+
+        return field_count;
+    }
+}
+
+namespace CSVTokenizer
+{
+    std::string to_string(Implementation implementation)
+    {
+        switch (implementation)
+        {
+        case Implementation::AVX2:
+            return "avx2";
+        case Implementation::SSE42:
+            return "sse4.2";
+        case Implementation::Scalar:
+        default:
+            return "scalar";
+        }
+    }
+
+    bool is_supported(Implementation implementation)
+    {
+        switch (implementation)
+        {
+#ifdef CSV_TOKENIZER_X86
+        case Implementation::AVX2:
+            return __builtin_cpu_supports("avx2");
+        case Implementation::SSE42:
+            return __builtin_cpu_supports("sse4.2");
+#endif
+        case Implementation::Scalar:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    Implementation best()
+    {
+        static const Implementation implementation = is_supported(Implementation::AVX2)    ? Implementation::AVX2
+                                                     : is_supported(Implementation::SSE42) ? Implementation::SSE42
+                                                                                           : Implementation::Scalar;
+        return implementation;
+    }
+
+    size_t tokenize(std::string_view line, std::string &bytes, std::vector<FieldRef> &fields)
+    {
+        static const MaskFunction structural_mask = mask_function(best());
+        return tokenize_with(line, bytes, fields, structural_mask);
+    }
+
+    size_t tokenize(std::string_view line, std::string &bytes, std::vector<FieldRef> &fields, Implementation implementation)
+    {
+        if (!is_supported(implementation))
+        {
+            throw std::runtime_error("CSV tokenizer '" + to_string(implementation) + "' is not supported on this CPU");
+        }
+        return tokenize_with(line, bytes, fields, mask_function(implementation));
+    }
+}
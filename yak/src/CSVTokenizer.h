@@ -0,0 +1,50 @@
+#ifndef CSV_TOKENIZER_H
+#define CSV_TOKENIZER_H
+
+#include "CSVDefinitions.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Splits a CSV line into fields, block by block instead of character by character.
+ *
+ * For every 32 byte block a kernel computes a bit mask of the structural characters (',' and '"'). Only those
+ * positions go through the UnquotedField / QuotedField / QuotedQuote state machine; the bytes in between are
+ * appended to the arena in one go. Quoting works exactly like the scalar state machine did:
+ *
+ *   "a,b"   -> a,b   (delimiters inside quotes are data)
+ *   "a""b"  -> a"b   (a doubled quote is a quote)
+ *   "ab"c   -> ab    (a character right after a closing quote is dropped)
+ *
+ * Kernels use AVX2 or SSE4.2 when the CPU has them (checked once at runtime), a plain loop otherwise. Lines come
+ * from MappedLineReader, which finds newlines with memchr.
+ */
+namespace CSVTokenizer
+{
+    enum class Implementation
+    {
+        Scalar,
+        SSE42,
+        AVX2
+    };
+
+    std::string to_string(Implementation implementation);
+    bool is_supported(Implementation implementation);
+
+    /**
+     * The fastest implementation this CPU supports.
+     */
+    Implementation best();
+
+    /**
+     * Appends the unquoted bytes of all fields of the line to bytes and one FieldRef per field to fields. Returns the
+     * number of fields, which is at least 1.
+     */
+    size_t tokenize(std::string_view line, std::string &bytes, std::vector<FieldRef> &fields);
+    size_t tokenize(std::string_view line, std::string &bytes, std::vector<FieldRef> &fields, Implementation implementation);
+}
+
+#endif
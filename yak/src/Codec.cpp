@@ -0,0 +1,229 @@
+#include "Codec.h"
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+namespace
+{
+    const size_t MIN_MATCH = 4;
+    const size_t MAX_OFFSET = 65535;
+    const size_t HASH_BITS = 16;
+
+    // The last literals never start a match, so matching can always read 4 bytes ahead
+    const size_t LAST_LITERALS = 5;
+
+    uint32_t read32(const char *p)
+    {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    uint32_t hash(uint32_t sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    char *write_length(char *out, size_t length)
+    {
+        while (length >= 255)
+        {
+            *out++ = static_cast<char>(255);
+            length -= 255;
+        }
+        *out++ = static_cast<char>(length);
+        return out;
+    }
+
+    char *write_sequence(char *out, const char *literals, size_t literal_length, size_t offset, size_t match_length)
+    {
+        const size_t match_code = match_length >= MIN_MATCH ? match_length - MIN_MATCH : 0;
+        char *token = out++;
+        *token = static_cast<char>(((literal_length < 15 ? literal_length : 15) << 4) | (match_code < 15 ? match_code : 15));
+        if (literal_length >= 15)
+        {
+            out = write_length(out, literal_length - 15);
+        }
+        std::memcpy(out, literals, literal_length);
+        out += literal_length;
+
+        if (match_length == 0)
+        {
+            return out;
+        }
+
+        *out++ = static_cast<char>(offset & 0xFF);
+        *out++ = static_cast<char>(offset >> 8);
+        if (match_code >= 15)
+        {
+            out = write_length(out, match_code - 15);
+        }
+        return out;
+    }
+
+    size_t read_length(const unsigned char *&in, const unsigned char *end, size_t length)
+    {
+        if (length != 15)
+        {
+            return length;
+        }
+
+        unsigned char b;
+        do
+        {
+            if (in >= end)
+            {
+                throw std::runtime_error("Corrupt compressed block: truncated length");
+            }
+            b = *in++;
+            length += b;
+        } while (b == 255);
+        return length;
+    }
+}
+
+std::string LZCodec::name() const
+{
+    return "lz";
+}
+
+size_t LZCodec::max_compressed_size(size_t size) const
+{
+    // Incompressible data only costs the literal length bytes
+    return size + size / 255 + 16;
+}
+
+size_t LZCodec::compress(const char *src, size_t size, char *dst) const
+{
+    // Positions + 1 of the last occurrence of every hash, 0 meaning none
+    std::unique_ptr<uint32_t[]> table(new uint32_t[size_t(1) << HASH_BITS]());
+
+    char *out = dst;
+    size_t anchor = 0;
+    size_t pos = 0;
+    while (size >= MIN_MATCH + LAST_LITERALS && pos + MIN_MATCH + LAST_LITERALS <= size)
+    {
+        const uint32_t sequence = read32(src + pos);
+        const uint32_t h = hash(sequence);
+        const size_t candidate = table[h];
+        table[h] = static_cast<uint32_t>(pos + 1);
+
+        if (candidate == 0 || pos - (candidate - 1) > MAX_OFFSET || read32(src + candidate - 1) != sequence)
+        {
+            pos++;
+            continue;
+        }
+
+        const size_t match = candidate - 1;
+        size_t length = MIN_MATCH;
+        while (pos + length + LAST_LITERALS < size && src[match + length] == src[pos + length])
+        {
+            length++;
+        }
+
+        out = write_sequence(out, src + anchor, pos - anchor, pos - match, length);
+        pos += length;
+        anchor = pos;
+    }
+
+    out = write_sequence(out, src + anchor, size - anchor, 0, 0);
+    return static_cast<size_t>(out - dst);
+}
+
+void LZCodec::decompress(const char *src, size_t size, char *dst, size_t raw_size) const
+{
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(src);
+    const unsigned char *in_end = in + size;
+    char *out = dst;
+    char *out_end = dst + raw_size;
+
+    while (in < in_end)
+    {
+        const unsigned char token = *in++;
+
+        const size_t literal_length = read_length(in, in_end, token >> 4);
+        if (literal_length > static_cast<size_t>(in_end - in) || literal_length > static_cast<size_t>(out_end - out))
+        {
+            throw std::runtime_error("Corrupt compressed block: literals out of bounds");
+        }
+        std::memcpy(out, in, literal_length);
+        in += literal_length;
+        out += literal_length;
+
+        // The last sequence ends after its literals
+        if (in == in_end)
+        {
+            break;
+        }
+
+        if (in_end - in < 2)
+        {
+            throw std::runtime_error("Corrupt compressed block: truncated offset");
+        }
+        const size_t offset = static_cast<size_t>(in[0]) | (static_cast<size_t>(in[1]) << 8);
+        in += 2;
+
+        const size_t match_length = read_length(in, in_end, token & 0x0F) + MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(out - dst) || match_length > static_cast<size_t>(out_end - out))
+        {
+            throw std::runtime_error("Corrupt compressed block: match out of bounds");
+        }
+
+        // Matches may overlap the bytes they produce, so copy byte by byte
+        const char *match = out - offset;
+        for (size_t i = 0; i < match_length; ++i)
+        {
+            out[i] = match[i];
+        }
+        out += match_length;
+    }
+
+    if (out != out_end)
+    {
+        throw std::runtime_error("Corrupt compressed block: wrong size");
+    }
+}
+
+void encode_block(const Codec &codec, const char *src, size_t size, std::string &frame, CodecStats *stats)
+{
+    auto start = std::chrono::steady_clock::now();
+    frame.resize(sizeof(BlockHeader) + codec.max_compressed_size(size));
+    size_t stored = codec.compress(src, size, frame.data() + sizeof(BlockHeader));
+    if (stored >= size)
+    {
+        stored = size;
+        std::memcpy(frame.data() + sizeof(BlockHeader), src, size);
+    }
+
+    BlockHeader header{static_cast<uint32_t>(size), static_cast<uint32_t>(stored)};
+    std::memcpy(frame.data(), &header, sizeof(header));
+    frame.resize(sizeof(BlockHeader) + stored);
+
+    if (stats != nullptr)
+    {
+        stats->raw_bytes += size;
+        stats->stored_bytes += frame.size();
+        stats->compress_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+void decode_block(const Codec &codec, const BlockHeader &header, const char *stored, std::string &block, CodecStats *stats)
+{
+    auto start = std::chrono::steady_clock::now();
+    block.resize(header.raw_size);
+    if (header.stored_size == header.raw_size)
+    {
+        std::memcpy(block.data(), stored, header.raw_size);
+    }
+    else
+    {
+        codec.decompress(stored, header.stored_size, block.data(), header.raw_size);
+    }
+
+    if (stats != nullptr)
+    {
+        stats->decompress_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Block compression for spilled runs. Codecs are stateless, one instance can be used from any number of threads.
+ */
+class Codec
+{
+public:
+    virtual ~Codec() = default;
+
+    virtual std::string name() const = 0;
+
+    /**
+     * Upper bound of the compressed size of size bytes.
+     */
+    virtual size_t max_compressed_size(size_t size) const = 0;
+
+    /**
+     * Compresses size bytes from src into dst, which has room for max_compressed_size(size) bytes. Returns the
+     * compressed size.
+     */
+    virtual size_t compress(const char *src, size_t size, char *dst) const = 0;
+
+    /**
+     * Decompresses size bytes from src into exactly raw_size bytes at dst. Throws std::runtime_error if the data is
+     * corrupt.
+     */
+    virtual void decompress(const char *src, size_t size, char *dst, size_t raw_size) const = 0;
+};
+
+/**
+ * LZ77 codec in the spirit of LZ4: greedy matching through a single hash table probe, byte aligned sequences of
+ * (literals, offset, match length) and no entropy coding, so both directions run at memory-ish speed.
+ *
+ * A sequence is a token (literal length in the high nibble, match length - 4 in the low nibble, 15 meaning more
+ * length bytes follow, each adding up to 255), the literals, a 2 byte little-endian offset and the extra match
+ * length bytes. The last sequence only has literals.
+ */
+class LZCodec : public Codec
+{
+public:
+    std::string name() const override;
+    size_t max_compressed_size(size_t size) const override;
+    size_t compress(const char *src, size_t size, char *dst) const override;
+    void decompress(const char *src, size_t size, char *dst, size_t raw_size) const override;
+};
+
+/**
+ * What compressing spilled runs did, summed over all writers and readers of a job (from any thread).
+ */
+struct CodecStats
+{
+    std::atomic<uint64_t> raw_bytes{0};
+    std::atomic<uint64_t> stored_bytes{0};
+    std::atomic<uint64_t> compress_ns{0};
+    std::atomic<uint64_t> decompress_ns{0};
+
+    void reset()
+    {
+        raw_bytes = 0;
+        stored_bytes = 0;
+        compress_ns = 0;
+        decompress_ns = 0;
+    }
+};
+
+/**
+ * Framing of compressed blocks in a file: the raw and the stored size (native byte order, files never leave the
+ * sorter), then the stored bytes. Blocks that don't get smaller are stored as they are (stored size == raw size).
+ */
+struct BlockHeader
+{
+    uint32_t raw_size;
+    uint32_t stored_size;
+};
+
+/**
+ * Frames size bytes from src, compressed with the codec, into frame. Adds to stats if given.
+ */
+void encode_block(const Codec &codec, const char *src, size_t size, std::string &frame, CodecStats *stats);
+
+/**
+ * Turns the stored bytes of a block back into header.raw_size bytes in block. Adds to stats if given.
+ */
+void decode_block(const Codec &codec, const BlockHeader &header, const char *stored, std::string &block, CodecStats *stats);
+
+#endif
@@ -44,6 +44,7 @@ bool DirectoryPoller::init_dir_watch()
   }
 
   m_wd = inotify_add_watch(m_fd, m_dir_to_watch.c_str(), IN_CREATE | IN_MOVE | IN_CLOSE);
+  return m_fd >= 0 && m_wd >= 0;
 }
 
 bool DirectoryPoller::should_add_file(const std::string &file_path, bool starting_up)
@@ -72,9 +73,11 @@ bool DirectoryPoller::check_and_add_file(const char *file_name, const std::strin
     m_file_paths.emplace_back(file_path);
     std::string s("The file ");
     s += file_path;
-    s += " was " << type;
+    s += " was " + type;
     Logging::INFO(s, m_name);
+    return true;
   }
+  return false;
 }
 
 PollResult DirectoryPoller::poll()
@@ -156,7 +159,7 @@ PollResult DirectoryPoller::poll()
             Logging::INFO(s, m_name);
           }
         }
-        else if (event->mask & (IN_MOVE_TO))
+        else if (event->mask & (IN_MOVED_TO))
         {
           if (event->mask & IN_ISDIR)
           {
@@ -11,7 +11,7 @@
 #include <condition_variable>
 #include <atomic>
 #include "AbstractPoller.h"
-#include "impl/PollResult.h"
+#include "PollResult.h"
 
 class DirectoryPollerBuilder;
 
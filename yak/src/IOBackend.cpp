@@ -0,0 +1,100 @@
+#include "IOBackend.h"
+#include "ThreadIOBackend.h"
+
+#ifdef __linux__
+#include "IOUringBackend.h"
+#endif
+
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+
+// A backend of a single stream: ring size, respectively threads
+const unsigned STREAM_QUEUE_DEPTH = 16;
+const size_t STREAM_IO_THREADS = 1;
+
+// A backend shared by all streams of a sorter
+const unsigned SHARED_QUEUE_DEPTH = 256;
+const size_t SHARED_IO_THREADS = 4;
+
+namespace
+{
+    std::atomic<IOEngine> preferred_engine{IOEngine::IOUring};
+
+    /*
+    Setting up a ring just to see whether the kernel lets us costs as much as using one, so it is only tried once.
+    */
+    bool io_uring_works()
+    {
+#ifdef __linux__
+        static std::once_flag probed;
+        static bool works = false;
+        std::call_once(probed, []()
+                       {
+                           try
+                           {
+                               IOUringBackend probe(STREAM_QUEUE_DEPTH);
+                               works = true;
+                           }
+                           catch (const std::runtime_error &)
+                           {
+                               // No ring for us, threads do the same
+                           } });
+        return works;
+#else
+        return false;
+#endif
+    }
+
+    std::unique_ptr<IOBackend> create_backend(unsigned queue_depth, size_t threads)
+    {
+#ifdef __linux__
+        if (preferred_engine == IOEngine::IOUring && io_uring_works())
+        {
+            try
+            {
+                return std::make_unique<IOUringBackend>(queue_depth);
+            }
+            catch (const std::runtime_error &)
+            {
+                // Out of locked memory for rings, threads do the same
+            }
+        }
+#endif
+        return std::make_unique<ThreadIOBackend>(threads);
+    }
+}
+
+/**
+ * Engine of every backend created from now on. Process wide, as it depends on what the kernel allows rather than on
+ * what a stream does.
+ *
+ */
+void IOBackend::set_engine(IOEngine engine)
+{
+    preferred_engine = engine;
+}
+
+IOEngine IOBackend::engine_in_use()
+{
+    return preferred_engine == IOEngine::IOUring && io_uring_works() ? IOEngine::IOUring : IOEngine::Threads;
+}
+
+/**
+ * A backend for the preferred engine, or a thread backend if io_uring can't be set up (engine_in_use() tells).
+ *
+ */
+std::unique_ptr<IOBackend> IOBackend::create()
+{
+    return create_backend(STREAM_QUEUE_DEPTH, STREAM_IO_THREADS);
+}
+
+/**
+ * Same, sized for all streams of a sorter at once: a wide merge shares one ring (or a few threads) instead of
+ * setting up one per input.
+ *
+ */
+std::unique_ptr<IOBackend> IOBackend::create_shared()
+{
+    return create_backend(SHARED_QUEUE_DEPTH, SHARED_IO_THREADS);
+}
@@ -0,0 +1,60 @@
+#ifndef IO_BACKEND_H
+#define IO_BACKEND_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * How asynchronous file I/O is done.
+ *
+ * IOUring: requests go into an io_uring submission queue (Linux 5.6 and later), no extra threads.
+ * Threads: requests are done with pread(2)/pwrite(2) on a few threads per backend. Used wherever io_uring isn't
+ *          available (older kernels, seccomp filters, other platforms).
+ */
+enum class IOEngine
+{
+    IOUring,
+    Threads
+};
+
+inline std::string to_string(IOEngine engine)
+{
+    switch (engine)
+    {
+    case IOEngine::Threads:
+        return "threads";
+    case IOEngine::IOUring:
+    default:
+        return "io_uring";
+    }
+}
+
+/**
+ * Positional reads and writes that run while the caller goes on with other work. Backends are thread safe, so a
+ * single one can serve every stream (reader or writer) of a sorter; requests complete in any order and are waited for
+ * by the id submit_read()/submit_write() returned, exactly once. Buffers must stay untouched until their request has
+ * been waited for, and destroying a backend waits for everything still in flight.
+ */
+class IOBackend
+{
+public:
+    virtual ~IOBackend() = default;
+
+    virtual IOEngine engine() const = 0;
+    virtual uint64_t submit_read(int fd, char *data, size_t size, uint64_t offset) = 0;
+    virtual uint64_t submit_write(int fd, const char *data, size_t size, uint64_t offset) = 0;
+
+    /**
+     * Waits for the request. Returns the bytes transferred (fewer than asked for at the end of a file) or -errno.
+     */
+    virtual int64_t wait(uint64_t request) = 0;
+
+    static void set_engine(IOEngine engine);
+    static IOEngine engine_in_use();
+    static std::unique_ptr<IOBackend> create();
+    static std::unique_ptr<IOBackend> create_shared();
+};
+
+#endif
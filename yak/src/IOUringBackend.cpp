@@ -0,0 +1,278 @@
+#ifdef __linux__
+#include "IOUringBackend.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    int io_uring_setup(unsigned entries, struct io_uring_params *params)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    int io_uring_register(int ring_fd, unsigned opcode, void *arg, unsigned nr_args)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args));
+    }
+
+    unsigned *field(void *ring, uint32_t offset)
+    {
+        return reinterpret_cast<unsigned *>(static_cast<char *>(ring) + offset);
+    }
+
+    std::runtime_error io_uring_error(const std::string &what)
+    {
+        return std::runtime_error(what + ": " + std::strerror(errno));
+    }
+}
+
+IOUringBackend::IOUringBackend(unsigned queue_depth) : m_ring_fd(-1),
+                                                       m_entries(0),
+                                                       m_sq_ring(MAP_FAILED),
+                                                       m_sq_ring_bytes(0),
+                                                       m_cq_ring(MAP_FAILED),
+                                                       m_cq_ring_bytes(0),
+                                                       m_sqes(static_cast<struct io_uring_sqe *>(MAP_FAILED)),
+                                                       m_sqes_bytes(0),
+                                                       m_next_id(0),
+                                                       m_in_flight(0),
+                                                       m_reaping(false)
+{
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    m_ring_fd = io_uring_setup(queue_depth, &params);
+    if (m_ring_fd < 0)
+    {
+        throw io_uring_error("io_uring_setup");
+    }
+    m_entries = params.sq_entries;
+
+    m_sq_ring_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_ring_bytes = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        m_sq_ring_bytes = m_cq_ring_bytes = std::max(m_sq_ring_bytes, m_cq_ring_bytes);
+    }
+
+    m_sq_ring = mmap(nullptr, m_sq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ring == MAP_FAILED)
+    {
+        std::runtime_error error = io_uring_error("mmap of the io_uring submission queue");
+        release();
+        throw error;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        m_cq_ring = m_sq_ring;
+    }
+    else
+    {
+        m_cq_ring = mmap(nullptr, m_cq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+        if (m_cq_ring == MAP_FAILED)
+        {
+            std::runtime_error error = io_uring_error("mmap of the io_uring completion queue");
+            release();
+            throw error;
+        }
+    }
+
+    m_sqes_bytes = params.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqes = static_cast<struct io_uring_sqe *>(mmap(nullptr, m_sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES));
+    if (m_sqes == MAP_FAILED)
+    {
+        std::runtime_error error = io_uring_error("mmap of the io_uring submission entries");
+        release();
+        throw error;
+    }
+
+    m_sq_tail = field(m_sq_ring, params.sq_off.tail);
+    m_sq_mask = field(m_sq_ring, params.sq_off.ring_mask);
+    m_sq_array = field(m_sq_ring, params.sq_off.array);
+    m_cq_head = field(m_cq_ring, params.cq_off.head);
+    m_cq_tail = field(m_cq_ring, params.cq_off.tail);
+    m_cq_mask = field(m_cq_ring, params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<struct io_uring_cqe *>(static_cast<char *>(m_cq_ring) + params.cq_off.cqes);
+
+    check_support();
+}
+
+IOUringBackend::~IOUringBackend()
+{
+    // The kernel may still write into buffers of requests nobody waited for
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_in_flight > 0)
+    {
+        reap(lock);
+    }
+    lock.unlock();
+    release();
+}
+
+void IOUringBackend::release()
+{
+    if (m_sqes != MAP_FAILED)
+    {
+        munmap(m_sqes, m_sqes_bytes);
+    }
+    if (m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring)
+    {
+        munmap(m_cq_ring, m_cq_ring_bytes);
+    }
+    if (m_sq_ring != MAP_FAILED)
+    {
+        munmap(m_sq_ring, m_sq_ring_bytes);
+    }
+    if (m_ring_fd >= 0)
+    {
+        ::close(m_ring_fd);
+    }
+}
+
+/**
+ * Plain reads and writes only came with Linux 5.6, before that a ring could only do vectored I/O.
+ *
+ */
+void IOUringBackend::check_support()
+{
+    const unsigned num_ops = IORING_OP_WRITE + 1;
+    std::vector<char> memory(sizeof(struct io_uring_probe) + num_ops * sizeof(struct io_uring_probe_op), 0);
+    struct io_uring_probe *probe = reinterpret_cast<struct io_uring_probe *>(memory.data());
+    if (io_uring_register(m_ring_fd, IORING_REGISTER_PROBE, probe, num_ops) < 0 ||
+        probe->last_op < IORING_OP_WRITE ||
+        !(probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) ||
+        !(probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED))
+    {
+        release();
+        throw std::runtime_error("io_uring without IORING_OP_READ/IORING_OP_WRITE");
+    }
+}
+
+IOEngine IOUringBackend::engine() const
+{
+    return IOEngine::IOUring;
+}
+
+uint64_t IOUringBackend::submit_read(int fd, char *data, size_t size, uint64_t offset)
+{
+    return submit(IORING_OP_READ, fd, data, size, offset);
+}
+
+uint64_t IOUringBackend::submit_write(int fd, const char *data, size_t size, uint64_t offset)
+{
+    return submit(IORING_OP_WRITE, fd, const_cast<char *>(data), size, offset);
+}
+
+uint64_t IOUringBackend::submit(uint8_t opcode, int fd, char *data, size_t size, uint64_t offset)
+{
+    // Never more requests in flight than the completion queue can take
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_in_flight >= m_entries)
+    {
+        reap(lock);
+    }
+
+    // Only the thread holding the mutex moves the tail, the kernel has taken everything up to it with the last
+    // io_uring_enter
+    const unsigned tail = *m_sq_tail;
+    const unsigned index = tail & *m_sq_mask;
+    struct io_uring_sqe *sqe = &m_sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(std::min<size_t>(size, UINT32_MAX));
+    sqe->off = offset;
+    sqe->user_data = m_next_id;
+    m_sq_array[index] = index;
+    __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    int submitted;
+    do
+    {
+        submitted = io_uring_enter(m_ring_fd, 1, 0, 0);
+    } while (submitted < 0 && errno == EINTR);
+    if (submitted != 1)
+    {
+        throw io_uring_error("io_uring_enter");
+    }
+
+    m_in_flight++;
+    return m_next_id++;
+}
+
+/**
+ * Moves all completions from the queue to m_completed, waiting for at least one if there are none. Called with the
+ * mutex held, which is let go of while waiting. Only one thread waits in the kernel, the others wait for it.
+ *
+ */
+void IOUringBackend::reap(std::unique_lock<std::mutex> &lock)
+{
+    if (m_reaping)
+    {
+        m_reaped.wait(lock);
+        return;
+    }
+
+    unsigned head = *m_cq_head;
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+    {
+        m_reaping = true;
+        lock.unlock();
+        int ret;
+        do
+        {
+            ret = io_uring_enter(m_ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+        } while (ret < 0 && errno == EINTR);
+        const int error = errno;
+        lock.lock();
+        m_reaping = false;
+        if (ret < 0)
+        {
+            m_reaped.notify_all();
+            errno = error;
+            throw io_uring_error("io_uring_enter");
+        }
+    }
+
+    const unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail)
+    {
+        const struct io_uring_cqe &cqe = m_cqes[head & *m_cq_mask];
+        m_completed.emplace(cqe.user_data, cqe.res);
+        m_in_flight--;
+        head++;
+    }
+    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+    m_reaped.notify_all();
+}
+
+int64_t IOUringBackend::wait(uint64_t request)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        auto it = m_completed.find(request);
+        if (it != m_completed.end())
+        {
+            int64_t result = it->second;
+            m_completed.erase(it);
+            return result;
+        }
+        reap(lock);
+    }
+}
+#endif
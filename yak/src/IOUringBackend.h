@@ -0,0 +1,65 @@
+#ifdef __linux__
+
+#ifndef IO_URING_BACKEND_H
+#define IO_URING_BACKEND_H
+
+#include "IOBackend.h"
+
+#include <linux/io_uring.h>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+
+/**
+ * IOBackend on an io_uring of its own, set up with the raw system calls (no liburing). Every request is submitted
+ * right away with a single io_uring_enter(2); completions are collected whenever somebody waits. Of all threads
+ * waiting, one at a time waits in the kernel and collects the completions for all of them.
+ *
+ * The constructor throws std::runtime_error if the kernel doesn't let us have a ring or doesn't know
+ * IORING_OP_READ/IORING_OP_WRITE.
+ */
+class IOUringBackend : public IOBackend
+{
+private:
+    int m_ring_fd;
+    unsigned m_entries;
+    void *m_sq_ring;
+    size_t m_sq_ring_bytes;
+    void *m_cq_ring;
+    size_t m_cq_ring_bytes;
+    struct io_uring_sqe *m_sqes;
+    size_t m_sqes_bytes;
+    unsigned *m_sq_tail;
+    unsigned *m_sq_mask;
+    unsigned *m_sq_array;
+    unsigned *m_cq_head;
+    unsigned *m_cq_tail;
+    unsigned *m_cq_mask;
+    struct io_uring_cqe *m_cqes;
+    uint64_t m_next_id;
+    size_t m_in_flight;
+    std::unordered_map<uint64_t, int64_t> m_completed;
+    std::mutex m_mutex;
+    std::condition_variable m_reaped;
+    bool m_reaping; // a thread waits in the kernel for completions
+
+private:
+    uint64_t submit(uint8_t opcode, int fd, char *data, size_t size, uint64_t offset);
+    void reap(std::unique_lock<std::mutex> &lock);
+    void check_support();
+    void release();
+
+public:
+    explicit IOUringBackend(unsigned queue_depth);
+    ~IOUringBackend();
+    IOUringBackend(const IOUringBackend &) = delete;
+    IOUringBackend &operator=(const IOUringBackend &) = delete;
+    IOEngine engine() const override;
+    uint64_t submit_read(int fd, char *data, size_t size, uint64_t offset) override;
+    uint64_t submit_write(int fd, const char *data, size_t size, uint64_t offset) override;
+    int64_t wait(uint64_t request) override;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef LOSER_TREE_H
+#define LOSER_TREE_H
+
+#include "SortKey.h"
+
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * Tournament (loser) tree for k-way merging.
+ *
+ * Leaves are the input cursors, every inner node remembers the loser of the match played there and node 0 holds
+ * the overall winner. After the winner's cursor advanced only the matches on its path to the root are replayed,
+ * which is exactly ceil(log2(k)) key comparisons per output record (a binary heap needs up to twice as many).
+ *
+ * A Cursor has to provide:
+ *
+ *   bool exhausted() const;          // no current record
+ *   uint64_t key_prefix() const;     // SortKey::prefix() of the current key
+ *   std::string_view key() const;    // sort key of the current record
+ *   void next();                     // advance to the next record
+ *
+ * Exhausted cursors lose against everything. Equal keys are won by the cursor with the lower index, so merging
+ * runs in the order they were produced is stable.
+ */
+template <typename Cursor>
+class LoserTree
+{
+private:
+    std::vector<Cursor *> m_cursors;
+    std::vector<size_t> m_tree;
+
+private:
+    bool is_smaller(size_t a, size_t b) const
+    {
+        const Cursor &ca = *m_cursors[a];
+        const Cursor &cb = *m_cursors[b];
+        if (ca.exhausted() || cb.exhausted())
+        {
+            return !ca.exhausted() || (cb.exhausted() && a < b);
+        }
+
+        if (ca.key_prefix() != cb.key_prefix())
+        {
+            return ca.key_prefix() < cb.key_prefix();
+        }
+
+        int rs = SortKey::compare(ca.key(), cb.key());
+        return rs < 0 || (rs == 0 && a < b);
+    }
+
+    void build()
+    {
+        const size_t k = m_cursors.size();
+        m_tree.assign(k == 0 ? 1 : k, 0);
+        if (k <= 1)
+        {
+            return;
+        }
+
+        // Play the initial tournament bottom up. Leaves live at [k, 2k), inner node n has children 2n and 2n + 1.
+        std::vector<size_t> winners(2 * k);
+        for (size_t i = 0; i < k; ++i)
+        {
+            winners[k + i] = i;
+        }
+
+        for (size_t n = k - 1; n >= 1; --n)
+        {
+            size_t a = winners[2 * n];
+            size_t b = winners[2 * n + 1];
+            if (is_smaller(a, b))
+            {
+                winners[n] = a;
+                m_tree[n] = b;
+            }
+            else
+            {
+                winners[n] = b;
+                m_tree[n] = a;
+            }
+        }
+        m_tree[0] = winners[1];
+    }
+
+public:
+    /**
+     * The cursors have to be positioned on their first record (or be exhausted) and must outlive the tree.
+     */
+    explicit LoserTree(std::vector<Cursor *> cursors) : m_cursors(std::move(cursors))
+    {
+        build();
+    }
+
+    bool empty() const
+    {
+        return m_cursors.empty() || m_cursors[m_tree[0]]->exhausted();
+    }
+
+    size_t top_index() const
+    {
+        return m_tree[0];
+    }
+
+    Cursor &top()
+    {
+        return *m_cursors[m_tree[0]];
+    }
+
+    /**
+     * Advances the winning cursor and replays its path to the root.
+     */
+    void pop()
+    {
+        const size_t k = m_cursors.size();
+        size_t winner = m_tree[0];
+        m_cursors[winner]->next();
+
+        for (size_t n = (winner + k) / 2; n >= 1; n /= 2)
+        {
+            if (is_smaller(m_tree[n], winner))
+            {
+                std::swap(m_tree[n], winner);
+            }
+        }
+        m_tree[0] = winner;
+    }
+};
+
+#endif
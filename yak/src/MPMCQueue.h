@@ -0,0 +1,365 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Bounded multi-producer multi-consumer queue, a drop-in for SafeQueue where many threads hit the same queue.
+ *
+ * A ring of cells that carry a sequence number each (Dmitry Vyukov's bounded MPMC queue): producers and consumers
+ * claim a cell with a single compare-and-swap on their end of the ring and never take a lock while there is room,
+ * respectively something to take. Only a thread that finds the queue full (empty) waits on a condition variable, and
+ * only threads that find someone waiting take the mutex to wake them up.
+ *
+ * The capacity is rounded up to a power of two.
+ */
+template <typename T>
+class MPMCQueue
+{
+public:
+    explicit MPMCQueue(size_t capacity) : m_capacity(round_up(capacity)),
+                                          m_mask(m_capacity - 1),
+                                          m_cells(new Cell[m_capacity])
+    {
+        for (size_t i = 0; i < m_capacity; ++i)
+        {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MPMCQueue(const MPMCQueue &) = delete;
+    MPMCQueue &operator=(const MPMCQueue &) = delete;
+
+    /**
+     * Adds t unless the queue is full. t is left alone if it wasn't added.
+     */
+    bool try_enqueue(T &&t)
+    {
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true)
+        {
+            cell = &m_cells[pos & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // Full, unless a consumer took the cell but hasn't let go of it yet
+                if (m_dequeue_pos.load(std::memory_order_relaxed) + m_capacity <= pos)
+                {
+                    return false;
+                }
+                std::this_thread::yield();
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+            else
+            {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(t);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Takes the front element into val unless the queue is empty.
+     */
+    bool try_dequeue(T &val)
+    {
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true)
+        {
+            cell = &m_cells[pos & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // Empty, unless a producer claimed the cell but hasn't filled it yet
+                if (m_enqueue_pos.load(std::memory_order_relaxed) <= pos)
+                {
+                    return false;
+                }
+                std::this_thread::yield();
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            }
+            else
+            {
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        val = std::move(cell->value);
+        cell->sequence.store(pos + m_capacity, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Adds t, waiting while the queue is full.
+     */
+    void enqueue(T t)
+    {
+        if (!try_enqueue(std::move(t)))
+        {
+            wait(m_not_full, m_waiting_producers, [&]()
+                 { return try_enqueue(std::move(t)); });
+        }
+        wake(m_not_empty, m_waiting_consumers);
+    }
+
+    /**
+     * Same, but gives up after ms. Returns whether t was added.
+     */
+    bool enqueue_with_timeout(const int ms, T t)
+    {
+        if (!try_enqueue(std::move(t)) && !wait_for(m_not_full, m_waiting_producers, ms, [&]()
+                                                    { return try_enqueue(std::move(t)); }))
+        {
+            return false;
+        }
+        wake(m_not_empty, m_waiting_consumers);
+        return true;
+    }
+
+    /**
+     * Adds all of vals in their order, waiting while the queue is full. Consumers are woken up once per run of
+     * elements added without waiting.
+     */
+    void enqueue_n(std::vector<T> &vals)
+    {
+        size_t i = 0;
+        while (i < vals.size())
+        {
+            while (i < vals.size() && try_enqueue(std::move(vals[i])))
+            {
+                ++i;
+            }
+            // Wake consumers before waiting for them to make room
+            wake(m_not_empty, m_waiting_consumers, true);
+            if (i < vals.size())
+            {
+                wait(m_not_full, m_waiting_producers, [&]()
+                     { return try_enqueue(std::move(vals[i])); });
+                ++i;
+            }
+        }
+        wake(m_not_empty, m_waiting_consumers, true);
+    }
+
+    /**
+     * Takes the front element, waiting while the queue is empty.
+     */
+    T dequeue()
+    {
+        T val;
+        if (!try_dequeue(val))
+        {
+            wait(m_not_empty, m_waiting_consumers, [&]()
+                 { return try_dequeue(val); });
+        }
+        wake_producers();
+        return val;
+    }
+
+    /**
+     * Same, but gives up after ms. Returns whether an element was taken into val.
+     */
+    bool dequeue_with_timeout(const int ms, T &val)
+    {
+        if (!try_dequeue(val) && !wait_for(m_not_empty, m_waiting_consumers, ms, [&]()
+                                           { return try_dequeue(val); }))
+        {
+            return false;
+        }
+        wake_producers();
+        return true;
+    }
+
+    /**
+     * Appends up to max elements to vals, waiting up to ms for the first one. Returns the number taken.
+     */
+    size_t dequeue_n_with_timeout(const int ms, std::vector<T> &vals, size_t max)
+    {
+        T val;
+        if (max == 0 || !dequeue_with_timeout(ms, val))
+        {
+            return 0;
+        }
+        vals.push_back(std::move(val));
+
+        size_t taken = 1;
+        while (taken < max && try_dequeue(val))
+        {
+            vals.push_back(std::move(val));
+            ++taken;
+        }
+        wake_producers(taken - 1);
+        return taken;
+    }
+
+    /**
+     * Same, waiting as long as it takes for the first element.
+     */
+    size_t dequeue_n(std::vector<T> &vals, size_t max)
+    {
+        if (max == 0)
+        {
+            return 0;
+        }
+        vals.push_back(dequeue());
+
+        size_t taken = 1;
+        T val;
+        while (taken < max && try_dequeue(val))
+        {
+            vals.push_back(std::move(val));
+            ++taken;
+        }
+        wake_producers(taken - 1);
+        return taken;
+    }
+
+    /**
+     * Number of elements in the queue, only a snapshot while other threads use it.
+     */
+    size_t size() const
+    {
+        size_t dequeued = m_dequeue_pos.load(std::memory_order_relaxed);
+        size_t enqueued = m_enqueue_pos.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t round_up(size_t capacity)
+    {
+        size_t rounded = 2;
+        while (rounded < capacity)
+        {
+            rounded <<= 1;
+        }
+        return rounded;
+    }
+
+    /*
+    A waiter registers before it checks the queue a last time, a thread that changed the queue checks for waiters
+    after the change. The fences order both, so either the waiter sees the change or the other thread sees the
+    waiter and takes the mutex, which the waiter only lets go of while waiting.
+    */
+    template <typename Predicate>
+    void wait(std::condition_variable &cv, std::atomic<size_t> &waiting, Predicate predicate)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        waiting.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cv.wait(lock, predicate);
+        waiting.fetch_sub(1);
+    }
+
+    template <typename Predicate>
+    bool wait_for(std::condition_variable &cv, std::atomic<size_t> &waiting, const int ms, Predicate predicate)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        waiting.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool done = cv.wait_for(lock, std::chrono::milliseconds(ms), predicate);
+        waiting.fetch_sub(1);
+        return done;
+    }
+
+    /*
+    A single element added is good for a single waiting consumer, waking them all would only have them fight over it.
+    */
+    void wake(std::condition_variable &cv, std::atomic<size_t> &waiting, bool all = false)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (all)
+            {
+                cv.notify_all();
+            }
+            else
+            {
+                cv.notify_one();
+            }
+        }
+    }
+
+    /*
+    Every cell freed wakes a waiting producer, so a producer is never left waiting while there is room (consumers may
+    take a few elements and then wait for the producers). Once the queue is down to half its capacity all of them are
+    woken at once, they have plenty of room then.
+    */
+    void wake_producers(size_t freed = 1)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        size_t waiting = m_waiting_producers.load(std::memory_order_relaxed);
+        if (waiting == 0 || freed == 0)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (freed >= waiting || size() <= m_capacity / 2)
+        {
+            m_not_full.notify_all();
+            return;
+        }
+        for (size_t i = 0; i < freed; ++i)
+        {
+            m_not_full.notify_one();
+        }
+    }
+
+    const size_t m_capacity;
+    const size_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+
+    // Each end of the ring on a cache line of its own
+    alignas(64) std::atomic<size_t> m_enqueue_pos{0};
+    alignas(64) std::atomic<size_t> m_dequeue_pos{0};
+
+    alignas(64) std::mutex m_mutex;
+    std::condition_variable m_not_empty;
+    std::condition_variable m_not_full;
+    std::atomic<size_t> m_waiting_producers{0};
+    std::atomic<size_t> m_waiting_consumers{0};
+};
+
+#endif
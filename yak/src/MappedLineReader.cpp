@@ -0,0 +1,137 @@
+#include "MappedLineReader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * A file that can't be opened reads as empty (is_open() tells), like a std::ifstream would.
+ *
+ */
+MappedLineReader::MappedLineReader(const std::string &file_path) : m_file_path(file_path),
+                                                                   m_open(false),
+                                                                   m_data(nullptr),
+                                                                   m_size(0),
+                                                                   m_pos(0),
+                                                                   m_released(0),
+                                                                   m_advised(0)
+{
+    int fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("Unable to stat '" + file_path + "': " + std::strerror(errno));
+    }
+
+    // mmap can't map an empty file
+    size_t size = static_cast<size_t>(st.st_size);
+    void *data = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    int error = errno;
+
+    // The mapping keeps the file around, the descriptor isn't needed anymore
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        throw std::runtime_error("Unable to map '" + file_path + "': " + std::strerror(error));
+    }
+
+    m_open = true;
+    m_size = size;
+    m_data = static_cast<char *>(data);
+    if (m_data != nullptr)
+    {
+        madvise(m_data, m_size, MADV_SEQUENTIAL);
+        read_ahead();
+    }
+}
+
+MappedLineReader::~MappedLineReader()
+{
+    close();
+}
+
+bool MappedLineReader::is_open() const
+{
+    return m_open;
+}
+
+size_t MappedLineReader::size() const
+{
+    return m_size;
+}
+
+bool MappedLineReader::next(std::string_view &line)
+{
+    if (m_pos >= m_size)
+    {
+        return false;
+    }
+
+    // The previous line is done with, everything before this one can go
+    if (m_pos - m_released >= RELEASE_BYTES)
+    {
+        release_behind();
+    }
+
+    // Keep a window ahead of the cursor on its way in
+    if (m_pos + READ_AHEAD_BYTES > m_advised && m_advised < m_size)
+    {
+        read_ahead();
+    }
+
+    const char *start = m_data + m_pos;
+    const char *end = static_cast<const char *>(std::memchr(start, '\n', m_size - m_pos));
+    if (end == nullptr)
+    {
+        // Last line without a newline
+        end = m_data + m_size;
+    }
+
+    line = std::string_view(start, end - start);
+    m_pos = std::min(static_cast<size_t>(end - m_data) + 1, m_size);
+    return true;
+}
+
+void MappedLineReader::release_behind()
+{
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t end = m_pos / page * page;
+    if (end > m_released)
+    {
+        munmap(m_data + m_released, end - m_released);
+        m_released = end;
+    }
+}
+
+void MappedLineReader::read_ahead()
+{
+    // Windows start at multiples of READ_AHEAD_BYTES, which keeps them page aligned
+    const size_t length = std::min(READ_AHEAD_BYTES, m_size - m_advised);
+    madvise(m_data + m_advised, length, MADV_WILLNEED);
+    m_advised += length;
+}
+
+void MappedLineReader::close()
+{
+    if (m_data != nullptr && m_size > m_released)
+    {
+        munmap(m_data + m_released, m_size - m_released);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_pos = 0;
+    m_released = 0;
+    m_advised = 0;
+    m_open = false;
+}
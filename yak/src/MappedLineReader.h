@@ -0,0 +1,50 @@
+#ifndef MAPPED_LINE_READER_H
+#define MAPPED_LINE_READER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * Reads a file line by line straight out of a read-only memory mapping, without copying the bytes into a string.
+ *
+ * Lines are handed out as views into the mapping (without the '\n', like std::getline). A view stays valid until
+ * the next call to next(): the mapping is read front to back (MADV_SEQUENTIAL) and pages behind the current line are
+ * unmapped every RELEASE_BYTES, so a large file never holds more than that of the page cache mapped.
+ *
+ * The kernel is asked to read the next READ_AHEAD_BYTES window (MADV_WILLNEED) before the cursor gets there, so
+ * lines are parsed while the following ones are still coming from disk instead of faulting them in page by page.
+ */
+class MappedLineReader
+{
+private:
+    static constexpr size_t RELEASE_BYTES = 16 * 1024 * 1024;
+    static constexpr size_t READ_AHEAD_BYTES = 8 * 1024 * 1024;
+
+private:
+    std::string m_file_path;
+    bool m_open;
+    char *m_data;
+    size_t m_size;
+    size_t m_pos;
+    size_t m_released;
+    size_t m_advised;
+
+private:
+    void release_behind();
+    void read_ahead();
+
+public:
+    explicit MappedLineReader(const std::string &file_path);
+    ~MappedLineReader();
+
+    MappedLineReader(const MappedLineReader &) = delete;
+    MappedLineReader &operator=(const MappedLineReader &) = delete;
+
+    bool is_open() const;
+    size_t size() const;
+    bool next(std::string_view &line);
+    void close();
+};
+
+#endif
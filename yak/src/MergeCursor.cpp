@@ -0,0 +1,138 @@
+#include "MergeCursor.h"
+#include "RunFormat.h"
+#include "SortKey.h"
+
+#include <stdexcept>
+
+MergeCursor::MergeCursor(const std::string &file_path, size_t buffer_bytes, const SpillOptions &spill, uint64_t start_offset) : m_source(nullptr),
+                                                                                                                                  m_file_path(file_path),
+                                                                                                                                  m_key_offset(0),
+                                                                                                                                  m_key_length(0),
+                                                                                                                                  m_key_prefix(0),
+                                                                                                                                  m_exhausted(false)
+{
+    if (spill.codec != nullptr)
+    {
+        if (start_offset > 0)
+        {
+            throw std::invalid_argument("Compressed run '" + file_path + "' can only be read from the start");
+        }
+        m_blocks = std::make_unique<BlockReader>(file_path, buffer_bytes, *spill.codec, spill.codec_stats, spill.buffer_pool, spill.io, spill.decode_pool);
+        if (m_blocks->is_open())
+        {
+            m_source = m_blocks.get();
+        }
+    }
+    else
+    {
+        m_in = std::make_unique<ReadAheadReader>(file_path, buffer_bytes, spill.buffer_pool, start_offset, spill.io);
+        if (m_in->is_open())
+        {
+            m_source = m_in.get();
+        }
+    }
+    next();
+}
+
+std::string_view MergeCursor::key() const
+{
+    return std::string_view(m_record).substr(m_key_offset, m_key_length);
+}
+
+std::string_view MergeCursor::payload() const
+{
+    return std::string_view(m_record).substr(m_key_offset + m_key_length);
+}
+
+Row MergeCursor::row()
+{
+    return RunFormat::decode_payload(payload(), m_fields);
+}
+
+/**
+ * Reads a varint length into the record. Returns false at the end of the run, which is only fine before the first
+ * byte of a record.
+ *
+ */
+bool MergeCursor::read_length(uint32_t &length, bool first)
+{
+    std::streambuf *in = m_source;
+    length = 0;
+    for (size_t i = 0; i < RunFormat::MAX_VARINT_BYTES; ++i)
+    {
+        int c = in->sbumpc();
+        if (c == std::char_traits<char>::eof())
+        {
+            if (first && i == 0)
+            {
+                return false;
+            }
+            throw std::runtime_error("Truncated record in run '" + m_file_path + "'");
+        }
+
+        m_record.push_back(static_cast<char>(c));
+        length |= static_cast<uint32_t>(c & 0x7F) << (7 * i);
+        if ((c & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    throw std::runtime_error("Invalid record length in run '" + m_file_path + "'");
+}
+
+void MergeCursor::set_range(std::string_view lower, std::string_view upper)
+{
+    m_upper = upper;
+    while (!m_exhausted && !lower.empty() && SortKey::is_smaller(key(), lower))
+    {
+        next();
+    }
+    if (!m_exhausted && !m_upper.empty() && !SortKey::is_smaller(key(), m_upper))
+    {
+        close();
+    }
+}
+
+void MergeCursor::next()
+{
+    // Keep the record in one piece, an intermediate merge copies it as is
+    m_record.clear();
+    uint32_t key_length = 0;
+    uint32_t payload_length = 0;
+    if (m_source == nullptr || !read_length(key_length, true))
+    {
+        m_exhausted = true;
+        return;
+    }
+    read_length(payload_length, false);
+
+    m_key_offset = m_record.size();
+    m_key_length = key_length;
+    m_record.resize(m_key_offset + key_length + payload_length);
+    if (m_source->sgetn(m_record.data() + m_key_offset, key_length + payload_length) != static_cast<std::streamsize>(key_length + payload_length))
+    {
+        throw std::runtime_error("Truncated record in run '" + m_file_path + "'");
+    }
+
+    m_key_prefix = SortKey::prefix(key());
+
+    if (!m_upper.empty() && !SortKey::is_smaller(key(), m_upper))
+    {
+        // The rest of the run belongs to another range
+        close();
+    }
+}
+
+void MergeCursor::close()
+{
+    m_source = nullptr;
+    if (m_blocks)
+    {
+        m_blocks->close();
+    }
+    if (m_in)
+    {
+        m_in->close();
+    }
+    m_exhausted = true;
+}
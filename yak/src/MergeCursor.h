@@ -0,0 +1,61 @@
+#ifndef MERGE_CURSOR_H
+#define MERGE_CURSOR_H
+
+#include "BlockReader.h"
+#include "CSVDefinitions.h"
+#include "ReadAheadReader.h"
+#include "SpillOptions.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Reads a sorted run (see RunFormat.h) record by record for the merge. Records carry their sort key, so moving onto
+ * a record is a read and the merge only ever compares keys; fields are decoded only when row() is asked for.
+ *
+ * The run is read through a ReadAheadReader holding buffer_bytes, so a wide merge neither turns into lots of small
+ * reads jumping between files nor waits for the disk whenever one of its inputs runs dry. Runs are read the way
+ * SpillOptions say they were written: compressed ones through a BlockReader on top of it.
+ *
+ * A cursor can also read just a key range of the run, for a merge split into ranges. Uncompressed runs can be
+ * entered at any record offset (see RunIndex), compressed ones only read from the start.
+ */
+class MergeCursor
+{
+private:
+    std::unique_ptr<ReadAheadReader> m_in;
+    std::unique_ptr<BlockReader> m_blocks;
+    std::streambuf *m_source;
+    std::string m_file_path;
+    std::string m_record;
+    size_t m_key_offset;
+    size_t m_key_length;
+    uint64_t m_key_prefix;
+    std::vector<FieldRef> m_fields;
+    std::string m_upper; // first key after the range, empty for no limit
+    bool m_exhausted;
+
+private:
+    bool read_length(uint32_t &length, bool first);
+
+public:
+    MergeCursor(const std::string &file_path, size_t buffer_bytes = 0, const SpillOptions &spill = SpillOptions(), uint64_t start_offset = 0);
+
+    /**
+     * Limits the cursor to keys from lower up to, but not including, upper. Empty bounds don't limit.
+     */
+    void set_range(std::string_view lower, std::string_view upper);
+    bool exhausted() const { return m_exhausted; }
+    uint64_t key_prefix() const { return m_key_prefix; }
+    std::string_view key() const;
+    std::string_view payload() const;
+    std::string_view record() const { return m_record; }
+    Row row();
+    void next();
+    void close();
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "MergePlanner.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+
+std::vector<MergeStep> MergePlanner::plan(const std::vector<uint64_t> &run_bytes, size_t max_fan_in)
+{
+    if (max_fan_in < 2)
+    {
+        throw std::runtime_error("A merge needs a fan-in of at least 2");
+    }
+
+    const size_t n = run_bytes.size();
+    std::vector<MergeStep> steps;
+    if (n <= max_fan_in)
+    {
+        std::vector<size_t> inputs(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            inputs[i] = i;
+        }
+
+        uint64_t bytes = 0;
+        for (auto b : run_bytes)
+        {
+            bytes += b;
+        }
+        steps.push_back(MergeStep{inputs, n, 1, bytes});
+        return steps;
+    }
+
+    // (bytes, id, pass the node is available after) in run order
+    struct Node
+    {
+        uint64_t bytes;
+        size_t id;
+        size_t pass;
+    };
+    std::vector<Node> nodes;
+    for (size_t i = 0; i < n; ++i)
+    {
+        nodes.push_back(Node{run_bytes[i], i, 0});
+    }
+
+    // Every step turns k nodes into one. Shrink the first step so that all later ones can merge max_fan_in nodes.
+    size_t fan_in = 1 + (n - 1) % (max_fan_in - 1);
+    if (fan_in == 1)
+    {
+        fan_in = max_fan_in;
+    }
+
+    size_t next_id = n;
+    while (nodes.size() > 1)
+    {
+        // Only neighbours are merged, so the inputs of every step stay in run order and the merge, which prefers
+        // lower inputs on equal keys, keeps rows with equal keys in run order. The smallest window goes first.
+        size_t first = 0;
+        uint64_t window = 0;
+        for (size_t i = 0; i < fan_in; ++i)
+        {
+            window += nodes[i].bytes;
+        }
+        uint64_t smallest = window;
+        for (size_t i = fan_in; i < nodes.size(); ++i)
+        {
+            window += nodes[i].bytes - nodes[i - fan_in].bytes;
+            if (window < smallest)
+            {
+                smallest = window;
+                first = i + 1 - fan_in;
+            }
+        }
+
+        MergeStep step{{}, next_id++, 0, smallest};
+        for (size_t i = first; i < first + fan_in; ++i)
+        {
+            step.inputs.push_back(nodes[i].id);
+            step.pass = std::max(step.pass, nodes[i].pass + 1);
+        }
+
+        nodes[first] = Node{step.bytes, step.output, step.pass};
+        nodes.erase(nodes.begin() + static_cast<std::ptrdiff_t>(first) + 1, nodes.begin() + static_cast<std::ptrdiff_t>(first + fan_in));
+        steps.push_back(step);
+        fan_in = max_fan_in;
+    }
+
+    return steps;
+}
+
+size_t MergePlanner::passes(const std::vector<MergeStep> &steps)
+{
+    size_t passes = 0;
+    for (const auto &step : steps)
+    {
+        passes = std::max(passes, step.pass);
+    }
+    return passes;
+}
+
+uint64_t MergePlanner::bytes_moved(const std::vector<MergeStep> &steps)
+{
+    uint64_t bytes = 0;
+    for (const auto &step : steps)
+    {
+        bytes += step.bytes;
+    }
+    return bytes;
+}
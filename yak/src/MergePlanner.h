@@ -0,0 +1,38 @@
+#ifndef MERGE_PLANNER_H
+#define MERGE_PLANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * One k-way merge of a cascade. Inputs and output are node ids: ids below the number of runs are the runs
+ * themselves, every step adds the next id for its output.
+ */
+struct MergeStep
+{
+    std::vector<size_t> inputs;
+    size_t output;
+    size_t pass;
+    uint64_t bytes;
+};
+
+/**
+ * Plans a cascaded merge of sorted runs where no merge reads more than max_fan_in inputs at once.
+ *
+ * Every merge step rewrites all the bytes of its inputs, so the cost of a plan is the sum of the bytes of all
+ * steps. Merging the smallest runs first keeps that low (as in the k-ary Huffman construction): the first step only
+ * merges as many runs as needed for every later step to be full, small runs pass through many steps and large runs
+ * go straight into the final merge. A step only merges neighbouring runs though, the smallest neighbours first, so
+ * rows with equal keys come out in run order. Steps of the same pass don't depend on each other and can run in
+ * parallel.
+ */
+class MergePlanner
+{
+public:
+    static std::vector<MergeStep> plan(const std::vector<uint64_t> &run_bytes, size_t max_fan_in);
+    static size_t passes(const std::vector<MergeStep> &steps);
+    static uint64_t bytes_moved(const std::vector<MergeStep> &steps);
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include "ParallelSort.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
+
+namespace
+{
+    /**
+     * Buckets of a chunk and how far sorting them got. Shared with the helper tasks, which may only get to run after
+     * the sort is over and then find nothing left to claim.
+     */
+    struct Buckets
+    {
+        const RowTable *table;
+        RowRef *rows;
+        std::vector<size_t> offsets; // bucket i holds rows [offsets[i], offsets[i + 1])
+        std::atomic<size_t> next{0};
+        size_t done = 0;
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable all_done;
+    };
+
+    /**
+     * Claims and sorts buckets until none are left.
+     */
+    void sort_buckets(Buckets &buckets)
+    {
+        const size_t count = buckets.offsets.size() - 1;
+        size_t sorted = 0;
+        std::exception_ptr error;
+        for (size_t i = buckets.next++; i < count; i = buckets.next++)
+        {
+            try
+            {
+                ParallelSort::sort_rows(*buckets.table, buckets.rows + buckets.offsets[i], buckets.offsets[i + 1] - buckets.offsets[i]);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            ++sorted;
+        }
+
+        if (sorted > 0)
+        {
+            std::lock_guard<std::mutex> lock(buckets.mutex);
+            buckets.done += sorted;
+            if (error && !buckets.error)
+            {
+                buckets.error = error;
+            }
+            if (buckets.done == count)
+            {
+                buckets.all_done.notify_all();
+            }
+        }
+    }
+}
+
+void ParallelSort::sort_rows(const RowTable &table, RowRef *rows, size_t n)
+{
+    // Short keys are radix sorted, anything else is compared
+    if (RadixSort::sort(table, rows, n))
+    {
+        return;
+    }
+
+    std::sort(rows, rows + n, [&table](const RowRef &a, const RowRef &b) -> bool
+              { return table.is_smaller(a, b); });
+}
+
+void ParallelSort::sort(RowTable &table, ThreadPool *pool)
+{
+    std::vector<RowRef> &rows = table.rows();
+    const size_t n = rows.size();
+
+    // Splitting only pays off if there is someone to share the buckets with
+    const size_t threads = pool && pool->idle() > 0 ? std::min(pool->size(), n / MIN_ROWS_PER_THREAD) : 1;
+    if (threads < 2)
+    {
+        sort_rows(table, rows.data(), n);
+        return;
+    }
+
+    auto is_smaller = [&table](const RowRef &a, const RowRef &b) -> bool
+    {
+        return table.is_smaller(a, b);
+    };
+
+    // Splitters from a sorted sample, seeded for repeatable bucket sizes
+    const size_t bucket_count = threads * BUCKETS_PER_THREAD;
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<size_t> pick(0, n - 1);
+    std::vector<RowRef> sample;
+    for (size_t i = 0; i < bucket_count * OVERSAMPLING; ++i)
+    {
+        sample.push_back(rows[pick(gen)]);
+    }
+    std::sort(sample.begin(), sample.end(), is_smaller);
+
+    std::vector<RowRef> splitters;
+    for (size_t i = 1; i < bucket_count; ++i)
+    {
+        splitters.push_back(sample[i * OVERSAMPLING]);
+    }
+
+    // Rows equal to a splitter all go to the bucket after it
+    std::vector<uint32_t> bucket_of(n);
+    std::vector<size_t> offsets(bucket_count + 1, 0);
+    for (size_t i = 0; i < n; ++i)
+    {
+        auto bucket = std::upper_bound(splitters.begin(), splitters.end(), rows[i], is_smaller) - splitters.begin();
+        bucket_of[i] = static_cast<uint32_t>(bucket);
+        ++offsets[bucket + 1];
+    }
+    for (size_t b = 0; b < bucket_count; ++b)
+    {
+        offsets[b + 1] += offsets[b];
+    }
+
+    std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+    std::vector<RowRef> partitioned(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        partitioned[fill[bucket_of[i]]++] = rows[i];
+    }
+    rows.swap(partitioned);
+
+    // The buckets are sorted with scratch memory of their own
+    std::vector<uint32_t>().swap(bucket_of);
+    std::vector<RowRef>().swap(partitioned);
+
+    auto buckets = std::make_shared<Buckets>();
+    buckets->table = &table;
+    buckets->rows = rows.data();
+    buckets->offsets = std::move(offsets);
+
+    for (size_t i = 1; i < threads; ++i)
+    {
+        if (!pool->submit_if_idle([buckets]()
+                                  { sort_buckets(*buckets); }))
+        {
+            break;
+        }
+    }
+    sort_buckets(*buckets);
+
+    // Buckets claimed by helpers may still be in progress
+    std::unique_lock<std::mutex> lock(buckets->mutex);
+    buckets->all_done.wait(lock, [&buckets, bucket_count]()
+                           { return buckets->done == bucket_count; });
+    if (buckets->error)
+    {
+        std::rethrow_exception(buckets->error);
+    }
+}
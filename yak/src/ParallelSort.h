@@ -0,0 +1,49 @@
+#ifndef PARALLEL_SORT_H
+#define PARALLEL_SORT_H
+
+#include "RadixSort.h"
+#include "RowTable.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * In-memory sort of a chunk that can spread over the worker pool.
+ *
+ * Sample sort: splitters picked from a sorted random sample cut the rows into buckets of about the same size, the
+ * rows are moved into their buckets and every bucket is sorted on its own (RadixSort if the keys allow, std::sort
+ * otherwise). The calling thread sorts buckets itself and idle workers of the pool join in, so a chunk sorted
+ * while all workers are busy with other chunks costs no more than sorting it alone, and the last chunk of a batch
+ * gets every core.
+ */
+namespace ParallelSort
+{
+    /** Chunks with fewer rows per thread are sorted sequentially. */
+    constexpr size_t MIN_ROWS_PER_THREAD = 16 * 1024;
+
+    /** More buckets than threads, so threads that join late still get some. */
+    constexpr size_t BUCKETS_PER_THREAD = 4;
+
+    /** Sample rows per bucket the splitters are picked from. */
+    constexpr size_t OVERSAMPLING = 32;
+
+    /**
+     * Memory sort() allocates per row at most, on top of the table: the bucket of every row and the partitioned rows
+     * while splitting, then whatever the buckets are sorted with.
+     */
+    constexpr size_t SCRATCH_BYTES_PER_ROW = std::max(sizeof(uint32_t) + sizeof(RowRef), RadixSort::SCRATCH_BYTES_PER_ROW);
+
+    /**
+     * Sorts the rows of table by key, on pool's idle workers too if pool isn't nullptr.
+     */
+    void sort(RowTable &table, ThreadPool *pool = nullptr);
+
+    /**
+     * Sequential sort of the n rows of table starting at rows.
+     */
+    void sort_rows(const RowTable &table, RowRef *rows, size_t n);
+}
+
+#endif
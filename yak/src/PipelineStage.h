@@ -0,0 +1,145 @@
+#ifndef PIPELINE_STAGE_H
+#define PIPELINE_STAGE_H
+
+#include "AbstractWorker.h"
+#include "SafeQueue.h"
+#include "SignalChannel.h"
+#include "logging/Logging.h"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Stage of the ingest pipeline. Every thread of the stage takes items off the input queue, hands them to the stage's
+ * function and puts what it returns on the output queue, until shutdown. Queues between stages are bounded: a stage
+ * that can't get rid of its output stops taking input, so a saturated stage holds back the stages before it instead
+ * of letting work pile up.
+ *
+ * The function is called with nothing once no input came in for IDLE_MS, so a stage can act on time passing too. It
+ * returns nothing if there is no output (always, if the stage has no output queue). With more than one thread it runs
+ * on all of them at once. Output the next stage has no room for by shutdown goes to the drop function, if any, so it
+ * can be cleaned up. An exception thrown by the function is logged and the input it threw on goes to the discard
+ * function, if any, so the stage goes on with the next input.
+ */
+template <typename In, typename Out>
+class PipelineStage : public AbstractWorker
+{
+public:
+    using Function = std::function<std::optional<Out>(std::optional<In>)>;
+    using Drop = std::function<void(Out &)>;
+    using Discard = std::function<void(In &)>;
+
+    static constexpr int IDLE_MS = 100;
+
+    PipelineStage(std::string name, std::shared_ptr<SignalChannel> sig_channel, size_t threads, std::shared_ptr<SafeQueue<In>> in, std::shared_ptr<SafeQueue<Out>> out, Function function, Drop drop = nullptr, Discard discard = nullptr) : AbstractWorker(name, sig_channel, std::chrono::milliseconds(0)),
+                                                                                                                                                                                                                                             m_threads(threads),
+                                                                                                                                                                                                                                             m_in(in),
+                                                                                                                                                                                                                                             m_out(out),
+                                                                                                                                                                                                                                             m_function(function),
+                                                                                                                                                                                                                                             m_drop(drop),
+                                                                                                                                                                                                                                             m_discard(discard)
+    {
+    }
+
+    PipelineStage(const PipelineStage &) = delete;
+    PipelineStage &operator=(const PipelineStage &) = delete;
+
+    ~PipelineStage()
+    {
+        join();
+    }
+
+    void start()
+    {
+        for (size_t i = 0; i < m_threads; ++i)
+        {
+            m_workers.emplace_back(&PipelineStage::run, this);
+        }
+    }
+
+    void join()
+    {
+        for (auto &worker : m_workers)
+        {
+            if (worker.joinable())
+            {
+                worker.join();
+            }
+        }
+    }
+
+private:
+    size_t m_threads;
+    std::shared_ptr<SafeQueue<In>> m_in;
+    std::shared_ptr<SafeQueue<Out>> m_out;
+    Function m_function;
+    Drop m_drop;
+    Discard m_discard;
+    std::vector<std::thread> m_workers;
+
+    void step() override
+    {
+        In item;
+        std::optional<In> input;
+        if (m_in->dequeue_with_timeout(IDLE_MS, item))
+        {
+            input = std::move(item);
+        }
+
+        // The function gets a copy, the input is still needed to clean up after it
+        std::optional<Out> result;
+        try
+        {
+            result = m_function(input);
+        }
+        catch (const std::exception &e)
+        {
+            fail(input, e.what());
+            return;
+        }
+        catch (...)
+        {
+            fail(input, "unknown error");
+            return;
+        }
+
+        if (!result || !m_out)
+        {
+            return;
+        }
+
+        // Waits for the next stage to make room, but not past a shutdown
+        while (!m_out->enqueue_with_timeout(IDLE_MS, *result))
+        {
+            if (m_sig_channel->m_shutdown_requested.load())
+            {
+                Logging::WARN("Shutting down, the next stage has no room for the last output", m_name);
+                if (m_drop)
+                {
+                    m_drop(*result);
+                }
+                return;
+            }
+        }
+    }
+
+    void fail(std::optional<In> &input, const std::string &error)
+    {
+        Logging::ERROR(std::string(input ? "Failed on an input: " : "Failed: ") + error, m_name);
+        if (input && m_discard)
+        {
+            m_discard(*input);
+        }
+    }
+
+    void clean() override
+    {
+    }
+};
+
+#endif
@@ -0,0 +1,219 @@
+#include "RadixSort.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    /** Buckets smaller than this are finished with a comparison sort. */
+    constexpr size_t SMALL_BUCKET = 64;
+
+    template <size_t WORDS>
+    struct KeyIndex
+    {
+        uint64_t words[WORDS];
+        uint32_t index;
+    };
+
+    static_assert(2 * sizeof(KeyIndex<3>) + sizeof(RowRef) <= RadixSort::SCRATCH_BYTES_PER_ROW, "Radix sort scratch is underestimated");
+
+    template <size_t WORDS>
+    inline unsigned digit(const KeyIndex<WORDS> &entry, size_t byte)
+    {
+        return static_cast<unsigned>(entry.words[byte / 8] >> (56 - 8 * (byte % 8))) & 0xFF;
+    }
+
+    template <size_t WORDS>
+    inline bool is_smaller(const KeyIndex<WORDS> &a, const KeyIndex<WORDS> &b)
+    {
+        for (size_t w = 0; w < WORDS; ++w)
+        {
+            if (a.words[w] != b.words[w])
+            {
+                return a.words[w] < b.words[w];
+            }
+        }
+        return a.index < b.index;
+    }
+
+    /**
+     * Least significant digit first, for keys of one word. Every pass is a stable counting sort on one byte.
+     */
+    void sort_lsd(std::vector<KeyIndex<1>> &entries, size_t key_bytes)
+    {
+        const size_t n = entries.size();
+        std::vector<std::array<uint32_t, 256>> counts(key_bytes);
+        for (auto &count : counts)
+        {
+            count.fill(0);
+        }
+        for (const auto &entry : entries)
+        {
+            for (size_t b = 0; b < key_bytes; ++b)
+            {
+                ++counts[b][digit(entry, b)];
+            }
+        }
+
+        std::vector<KeyIndex<1>> scratch(n);
+        for (size_t b = key_bytes; b-- > 0;)
+        {
+            std::array<uint32_t, 256> &count = counts[b];
+            if (count[digit(entries[0], b)] == n)
+            {
+                continue;
+            }
+
+            uint32_t offset = 0;
+            for (auto &c : count)
+            {
+                uint32_t next = offset + c;
+                c = offset;
+                offset = next;
+            }
+
+            for (const auto &entry : entries)
+            {
+                scratch[count[digit(entry, b)]++] = entry;
+            }
+            entries.swap(scratch);
+        }
+    }
+
+    /**
+     * Most significant digit first, for longer keys. Buckets are split byte by byte only until they are small,
+     * so the trailing bytes of keys that already differ early (random ids) are never looked at.
+     */
+    template <size_t WORDS>
+    void sort_msd(KeyIndex<WORDS> *entries, KeyIndex<WORDS> *scratch, size_t n, size_t byte, size_t key_bytes)
+    {
+        while (n >= SMALL_BUCKET && byte < key_bytes)
+        {
+            std::array<size_t, 256> count;
+            count.fill(0);
+            for (size_t i = 0; i < n; ++i)
+            {
+                ++count[digit(entries[i], byte)];
+            }
+
+            if (count[digit(entries[0], byte)] == n)
+            {
+                ++byte;
+                continue;
+            }
+
+            std::array<size_t, 256> offset;
+            size_t total = 0;
+            for (size_t d = 0; d < 256; ++d)
+            {
+                offset[d] = total;
+                total += count[d];
+            }
+            for (size_t i = 0; i < n; ++i)
+            {
+                scratch[offset[digit(entries[i], byte)]++] = entries[i];
+            }
+            std::copy(scratch, scratch + n, entries);
+
+            size_t begin = 0;
+            for (size_t d = 0; d < 256; ++d)
+            {
+                if (count[d] > 1)
+                {
+                    sort_msd(entries + begin, scratch + begin, count[d], byte + 1, key_bytes);
+                }
+                begin += count[d];
+            }
+            return;
+        }
+
+        if (byte < key_bytes)
+        {
+            std::sort(entries, entries + n, is_smaller<WORDS>);
+        }
+    }
+
+    template <size_t WORDS>
+    void sort_words(const RowTable &table, RowRef *rows, size_t n, size_t key_bytes)
+    {
+        std::vector<KeyIndex<WORDS>> entries(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            std::string_view key = table.key(rows[i]);
+            unsigned char bytes[WORDS * 8] = {};
+            std::memcpy(bytes, key.data(), key.size());
+
+            // The first word is the key prefix the table already keeps
+            KeyIndex<WORDS> &entry = entries[i];
+            entry.words[0] = rows[i].key_prefix;
+            for (size_t w = 1; w < WORDS; ++w)
+            {
+                uint64_t word = 0;
+                for (size_t b = 0; b < 8; ++b)
+                {
+                    word = (word << 8) | bytes[w * 8 + b];
+                }
+                entry.words[w] = word;
+            }
+            entry.index = static_cast<uint32_t>(i);
+        }
+
+        if constexpr (WORDS == 1)
+        {
+            sort_lsd(entries, key_bytes);
+        }
+        else
+        {
+            std::vector<KeyIndex<WORDS>> scratch(n);
+            sort_msd(entries.data(), scratch.data(), n, 0, key_bytes);
+        }
+
+        std::vector<RowRef> sorted;
+        sorted.reserve(n);
+        for (const auto &entry : entries)
+        {
+            sorted.push_back(rows[entry.index]);
+        }
+        std::copy(sorted.begin(), sorted.end(), rows);
+    }
+}
+
+bool RadixSort::sort(RowTable &table)
+{
+    return sort(table, table.rows().data(), table.size());
+}
+
+bool RadixSort::sort(const RowTable &table, RowRef *rows, size_t n)
+{
+    if (n < MIN_ROWS)
+    {
+        return false;
+    }
+
+    size_t key_bytes = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        key_bytes = std::max<size_t>(key_bytes, rows[i].key_length);
+        if (key_bytes > MAX_KEY_BYTES)
+        {
+            return false;
+        }
+    }
+
+    if (key_bytes <= 8)
+    {
+        sort_words<1>(table, rows, n, key_bytes);
+    }
+    else if (key_bytes <= 16)
+    {
+        sort_words<2>(table, rows, n, key_bytes);
+    }
+    else
+    {
+        sort_words<3>(table, rows, n, key_bytes);
+    }
+    return true;
+}
@@ -0,0 +1,43 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include "RowTable.h"
+
+#include <cstddef>
+
+/**
+ * Radix sort for the rows of a RowTable.
+ *
+ * Every key is copied, zero padded, into one to three 8-byte words next to its row index and those (key, index)
+ * pairs are sorted one byte digit at a time. Keys of one word are sorted LSD, starting at the last byte, and
+ * digits every key agrees on (tag bytes, the high bytes of small numbers, padding) are detected from the
+ * histograms and skipped. Longer keys are sorted MSD, starting at the first byte, and buckets smaller than 64
+ * entries are finished with std::sort on (key, index). The rows are permuted once at the end.
+ *
+ * Padding keeps the order because SortKey encodings of the same columns are prefix free: two different keys
+ * always differ at a byte both of them have. Equal keys keep their input order.
+ */
+namespace RadixSort
+{
+    /** Longer keys are left to the comparison sort. */
+    constexpr size_t MAX_KEY_BYTES = 24;
+
+    /** Below this many rows std::sort is faster than building histograms. */
+    constexpr size_t MIN_ROWS = 256;
+
+    /** Memory sort() allocates per row at most: keys of up to three words plus index, twice, and the permutation. */
+    constexpr size_t SCRATCH_BYTES_PER_ROW = 2 * 32 + sizeof(RowRef);
+
+    /**
+     * Sorts the rows of table by key. Returns false, leaving the table untouched, if the keys are too long or
+     * there are too few rows for radix sorting to pay off.
+     */
+    bool sort(RowTable &table);
+
+    /**
+     * Same for the n rows of table starting at rows, which may be any part of table.rows().
+     */
+    bool sort(const RowTable &table, RowRef *rows, size_t n);
+}
+
+#endif
@@ -0,0 +1,210 @@
+#include "ReadAheadReader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * The buffer size is what the reader holds in total, split over the read-ahead buffers.
+ *
+ */
+ReadAheadReader::ReadAheadReader(const std::string &file_path, size_t buffer_bytes, AlignedBufferPool *direct_pool, uint64_t start_offset, IOBackend *io) : m_file_path(file_path),
+                                                                                                                                                            m_fd(-1),
+                                                                                                                                                            m_file_size(0),
+                                                                                                                                                            m_next_offset(start_offset),
+                                                                                                                                                            m_skip(0),
+                                                                                                                                                            m_direct(false),
+                                                                                                                                                            m_current(READ_AHEAD_BUFFERS),
+                                                                                                                                                            m_io(io)
+{
+#ifdef O_DIRECT
+    if (direct_pool != nullptr)
+    {
+        m_fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+        m_direct = m_fd >= 0;
+    }
+#endif
+    if (!m_direct)
+    {
+        m_fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (m_fd < 0)
+    {
+        return;
+    }
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0)
+    {
+        int error = errno;
+        ::close(m_fd);
+        m_fd = -1;
+        throw std::runtime_error("Unable to stat '" + file_path + "': " + std::strerror(error));
+    }
+    m_file_size = static_cast<uint64_t>(st.st_size);
+    if (m_direct)
+    {
+        // O_DIRECT reads start at a block boundary
+        m_next_offset = AlignedBuffer::align_down(start_offset);
+        m_skip = static_cast<size_t>(start_offset - m_next_offset);
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    const size_t bytes = std::max(buffer_bytes / READ_AHEAD_BUFFERS, MIN_BUFFER_BYTES);
+    for (size_t i = 0; i < READ_AHEAD_BUFFERS; ++i)
+    {
+        m_buffers.push_back(m_direct ? direct_pool->acquire(bytes) : AlignedBuffer(bytes));
+    }
+    if (m_io == nullptr)
+    {
+        m_own_io = IOBackend::create();
+        m_io = m_own_io.get();
+    }
+    for (size_t i = 0; i < READ_AHEAD_BUFFERS; ++i)
+    {
+        submit(i);
+    }
+}
+
+ReadAheadReader::~ReadAheadReader()
+{
+    try
+    {
+        close();
+    }
+    catch (...)
+    {
+        // Nobody reads anymore
+    }
+}
+
+bool ReadAheadReader::is_open() const
+{
+    return m_fd >= 0;
+}
+
+void ReadAheadReader::close()
+{
+    if (m_fd < 0)
+    {
+        return;
+    }
+
+    // Reads in flight still go into the buffers and use the descriptor
+    for (const auto &read : m_reads)
+    {
+        m_io->wait(read.request);
+    }
+    m_reads.clear();
+    ::close(m_fd);
+    m_fd = -1;
+    setg(nullptr, nullptr, nullptr);
+    m_buffers.clear();
+}
+
+/**
+ * Starts filling the buffer with the next part of the file, unless everything has been asked for already.
+ *
+ */
+void ReadAheadReader::submit(size_t buffer)
+{
+    if (m_next_offset >= m_file_size)
+    {
+        return;
+    }
+
+    // O_DIRECT only reads whole blocks, the last one just comes back short
+    const size_t size = static_cast<size_t>(std::min<uint64_t>(m_buffers[buffer].size(), m_file_size - m_next_offset));
+    const size_t request_size = m_direct ? m_buffers[buffer].size() : size;
+    m_reads.push_back({buffer, m_io->submit_read(m_fd, m_buffers[buffer].data(), request_size, m_next_offset), m_next_offset, size});
+    m_next_offset += size;
+}
+
+/**
+ * Waits for the read and returns how much of the buffer holds data. A short read is completed right away, so the
+ * buffer always holds everything up to where the next one starts.
+ *
+ */
+size_t ReadAheadReader::complete(const Read &read)
+{
+    int64_t n = m_io->wait(read.request);
+    if (n < 0)
+    {
+        throw std::runtime_error("Unable to read '" + m_file_path + "': " + std::strerror(static_cast<int>(-n)));
+    }
+
+    size_t done = std::min(static_cast<size_t>(n), read.size);
+    char *data = m_buffers[read.buffer].data();
+#ifdef O_DIRECT
+    if (done < read.size && m_direct)
+    {
+        // The rest starts at an odd offset, which O_DIRECT can't read
+        int flags = fcntl(m_fd, F_GETFL);
+        if (flags >= 0 && fcntl(m_fd, F_SETFL, flags & ~O_DIRECT) == 0)
+        {
+            m_direct = false;
+        }
+    }
+#endif
+    while (done < read.size)
+    {
+        ssize_t more = ::pread(m_fd, data + done, read.size - done, static_cast<off_t>(read.offset + done));
+        if (more < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (more < 0)
+        {
+            throw std::runtime_error("Unable to read '" + m_file_path + "': " + std::strerror(errno));
+        }
+        if (more == 0)
+        {
+            // The file got shorter since we looked
+            break;
+        }
+        done += static_cast<size_t>(more);
+    }
+    return done;
+}
+
+ReadAheadReader::int_type ReadAheadReader::underflow()
+{
+    if (gptr() < egptr())
+    {
+        return traits_type::to_int_type(*gptr());
+    }
+
+    // The buffer just consumed goes back to reading ahead
+    if (m_current < READ_AHEAD_BUFFERS)
+    {
+        submit(m_current);
+        m_current = READ_AHEAD_BUFFERS;
+    }
+
+    while (!m_reads.empty())
+    {
+        Read read = m_reads.front();
+        m_reads.pop_front();
+        size_t size = complete(read);
+        m_current = read.buffer;
+        size_t skip = std::min(m_skip, size);
+        m_skip -= skip;
+        if (size > skip)
+        {
+            char *data = m_buffers[read.buffer].data();
+            setg(data, data + skip, data + size);
+            return traits_type::to_int_type(*gptr());
+        }
+        submit(m_current);
+        m_current = READ_AHEAD_BUFFERS;
+    }
+
+    setg(nullptr, nullptr, nullptr);
+    return traits_type::eof();
+}
@@ -0,0 +1,74 @@
+#ifndef READ_AHEAD_READER_H
+#define READ_AHEAD_READER_H
+
+#include "AlignedBuffer.h"
+#include "IOBackend.h"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+/**
+ * Stream buffer reading a file front to back through an IOBackend, with READ_AHEAD_BUFFERS reads in flight: while
+ * the caller consumes one buffer the following ones are already being filled, so a page cache miss on one input of
+ * a merge doesn't stall the merge.
+ *
+ * With a buffer pool the file is read with O_DIRECT into aligned buffers from the pool, bypassing the page cache
+ * (unless the file system can't do that).
+ *
+ * Reading may start at any offset into the file.
+ *
+ * Reads go through the given backend, which may be shared with other streams, or through one of the reader's own.
+ *
+ * A file that can't be opened reads as empty (is_open() tells). Read errors throw std::runtime_error from the reading
+ * call.
+ */
+class ReadAheadReader : public std::streambuf
+{
+private:
+    static constexpr size_t READ_AHEAD_BUFFERS = 4;
+    static constexpr size_t MIN_BUFFER_BYTES = 16 * 1024;
+
+    struct Read
+    {
+        size_t buffer;
+        uint64_t request;
+        uint64_t offset;
+        size_t size;
+    };
+
+private:
+    std::string m_file_path;
+    int m_fd;
+    uint64_t m_file_size;
+    uint64_t m_next_offset;
+    size_t m_skip; // bytes before the start offset the first read brings in
+    bool m_direct;
+    std::vector<AlignedBuffer> m_buffers;
+    std::deque<Read> m_reads;
+    size_t m_current;
+
+    // Last, so it is gone (and done with the buffers) before they are
+    std::unique_ptr<IOBackend> m_own_io;
+    IOBackend *m_io;
+
+private:
+    void submit(size_t buffer);
+    size_t complete(const Read &read);
+
+protected:
+    int_type underflow() override;
+
+public:
+    ReadAheadReader(const std::string &file_path, size_t buffer_bytes, AlignedBufferPool *direct_pool = nullptr, uint64_t start_offset = 0, IOBackend *io = nullptr);
+    ~ReadAheadReader();
+    ReadAheadReader(const ReadAheadReader &) = delete;
+    ReadAheadReader &operator=(const ReadAheadReader &) = delete;
+    bool is_open() const;
+    void close();
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include "ReplacementSelection.h"
+#include "CSV.h"
+#include "MappedLineReader.h"
+#include "RunFormat.h"
+#include "SortKey.h"
+#include "logging/Logging.h"
+
+#include <algorithm>
+#include <memory>
+
+ReplacementSelection::ReplacementSelection(const std::vector<std::string> &header, const std::vector<size_t> &key_columns, size_t memory_bytes) : m_header(header),
+                                                                                                                                                  m_key_columns(key_columns),
+                                                                                                                                                  m_memory_bytes(memory_bytes),
+                                                                                                                                                  m_heap_bytes(0),
+                                                                                                                                                  m_rows(0)
+{
+    m_name = "ReplacementSelection";
+}
+
+/**
+ * Heap order: "a comes out after b". Records of a later run always come out after those of the current one.
+ *
+ */
+bool ReplacementSelection::is_after(const Record &a, const Record &b)
+{
+    if (a.run != b.run)
+    {
+        return a.run > b.run;
+    }
+    if (a.key_prefix != b.key_prefix)
+    {
+        return a.key_prefix > b.key_prefix;
+    }
+    return SortKey::is_smaller(b.key, a.key);
+}
+
+size_t ReplacementSelection::footprint(const Record &record)
+{
+    return sizeof(Record) + record.key.capacity() + record.payload.capacity();
+}
+
+ReplacementSelection::Record ReplacementSelection::make_record(std::string_view line, size_t run)
+{
+    Row row = CSV::convert_to_row(line, m_table);
+
+    Record record{run, 0, SortKey::encode(row, m_key_columns), std::string()};
+    record.key_prefix = SortKey::prefix(record.key);
+    RunFormat::append_payload(record.payload, row, m_header.size());
+    return record;
+}
+
+void ReplacementSelection::push(Record &&record)
+{
+    m_heap_bytes += footprint(record);
+    m_heap.push_back(std::move(record));
+    std::push_heap(m_heap.begin(), m_heap.end(), is_after);
+}
+
+ReplacementSelection::Record ReplacementSelection::pop()
+{
+    std::pop_heap(m_heap.begin(), m_heap.end(), is_after);
+    Record record = std::move(m_heap.back());
+    m_heap.pop_back();
+    m_heap_bytes -= footprint(record);
+    return record;
+}
+
+/**
+ * Consumes the files one after the other as a single input and writes it as sorted runs named
+ * <run_path_prefix>_<n>_s + SPILL_SUFFIX, written the way the spill options say. Runs don't stop at file boundaries.
+ *
+ */
+std::vector<std::string> ReplacementSelection::generate_runs(const std::vector<std::string> &file_paths, const std::string &run_path_prefix, const SpillOptions &spill)
+{
+    std::vector<std::string> paths;
+    std::string_view line;
+    std::unique_ptr<MappedLineReader> in;
+    size_t next_file = 0;
+
+    auto read_line = [&]() -> bool
+    {
+        while (true)
+        {
+            if (in && in->next(line))
+            {
+                return true;
+            }
+
+            if (next_file == file_paths.size())
+            {
+                in.reset();
+                return false;
+            }
+
+            // Every file starts with its own header
+            in = std::make_unique<MappedLineReader>(file_paths[next_file++]);
+            in->next(line);
+        }
+    };
+
+    // Fill the heap up to the budget
+    bool has_input = true;
+    while (m_heap_bytes < m_memory_bytes && (has_input = read_line()))
+    {
+        push(make_record(line, 0));
+        m_rows++;
+    }
+    Logging::INFO("Heap holds " + std::to_string(m_heap.size()) + " records (" + std::to_string(m_heap_bytes / 1024) + "kb)", m_name);
+
+    // Compressing is left to a background thread, the heap keeps going meanwhile
+    BufferedWriter out(WRITE_BUFFER_BYTES, FlushPolicy::WhenFull, spill.codec != nullptr);
+    out.set_codec(spill.codec, spill.codec_stats);
+    out.set_direct_io(spill.buffer_pool);
+    out.set_io(spill.io);
+    std::string encoded;
+    RunIndex index;
+    size_t current_run = 0;
+
+    auto close_run = [&]()
+    {
+        out.close();
+        if (spill.run_indexes != nullptr)
+        {
+            spill.run_indexes->put(paths.back(), std::move(index));
+        }
+        index = RunIndex();
+    };
+
+    while (!m_heap.empty())
+    {
+        Record record = pop();
+        if (record.run != current_run || !out.is_open())
+        {
+            if (out.is_open())
+            {
+                close_run();
+            }
+            current_run = record.run;
+            paths.push_back(run_path_prefix + "_" + std::to_string(paths.size()) + "_s" + SPILL_SUFFIX);
+            out.open(paths.back());
+        }
+        encoded.clear();
+        RunFormat::append_record(encoded, record.key, record.payload);
+        out.write(encoded);
+        index.add(record.key, encoded.size());
+
+        if (has_input && (has_input = read_line()))
+        {
+            // A record smaller than the one just written has to wait for the next run
+            Record next = make_record(line, current_run);
+            if (SortKey::is_smaller(next.key, record.key))
+            {
+                next.run = current_run + 1;
+            }
+            push(std::move(next));
+            m_rows++;
+        }
+    }
+
+    if (out.is_open())
+    {
+        close_run();
+    }
+
+    return paths;
+}
+
+size_t ReplacementSelection::rows() const
+{
+    return m_rows;
+}
@@ -0,0 +1,54 @@
+#ifndef REPLACEMENT_SELECTION_H
+#define REPLACEMENT_SELECTION_H
+
+#include "RowTable.h"
+#include "SpillOptions.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Run generation by replacement selection.
+ *
+ * Records stream through a min-heap that holds as many records as fit into the memory budget. The smallest record
+ * is written to the current run and replaced by the next input record; if that one sorts before the record just
+ * written it can't go into the current run anymore and is tagged for the next one. On random input runs end up
+ * about twice the size of the heap, on (partly) sorted input they get much longer.
+ */
+class ReplacementSelection
+{
+private:
+    struct Record
+    {
+        size_t run;
+        uint64_t key_prefix;
+        std::string key;
+        std::string payload; // already encoded the way sorted runs are written
+    };
+
+private:
+    std::string m_name;
+    std::vector<std::string> m_header;
+    std::vector<size_t> m_key_columns;
+    size_t m_memory_bytes;
+    std::vector<Record> m_heap;
+    size_t m_heap_bytes;
+    RowTable m_table;
+    size_t m_rows;
+
+private:
+    static bool is_after(const Record &a, const Record &b);
+    static size_t footprint(const Record &record);
+    Record make_record(std::string_view line, size_t run);
+    void push(Record &&record);
+    Record pop();
+
+public:
+    ReplacementSelection(const std::vector<std::string> &header, const std::vector<size_t> &key_columns, size_t memory_bytes);
+    std::vector<std::string> generate_runs(const std::vector<std::string> &file_paths, const std::string &run_path_prefix, const SpillOptions &spill = SpillOptions());
+    size_t rows() const;
+};
+
+#endif
@@ -0,0 +1,25 @@
+#include "Resampler.h"
+
+Resampler::Resampler(size_t id_column, size_t timestamp_column, size_t minutes) : m_id_column(id_column),
+                                                                                   m_timestamp_column(timestamp_column),
+                                                                                   m_minutes(static_cast<long>(minutes)),
+                                                                                   m_first(true),
+                                                                                   m_current_timestamp(0)
+{
+}
+
+bool Resampler::keep(const Row &row)
+{
+    std::string_view id = row.at(m_id_column);
+    long timestamp = stol(std::string(row.at(m_timestamp_column)));
+
+    // The first row of an id is always kept
+    if (m_first || id.compare(m_current_id) != 0 || timestamp > m_current_timestamp + m_minutes)
+    {
+        m_first = false;
+        m_current_id = id;
+        m_current_timestamp = timestamp;
+        return true;
+    }
+    return false;
+}
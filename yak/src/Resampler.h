@@ -0,0 +1,36 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include "CSVDefinitions.h"
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Downsampling of rows sorted by (id, timestamp), one row at a time. Of every id the first row is kept, and after
+ * that a row only if its timestamp is more than the given number of minutes past the last row kept.
+ *
+ * Being a streaming filter, it can sit right behind the final merge so the sorted data doesn't have to be written
+ * and read back just to be resampled. A copy starts from the state of the original, so copies of a fresh resampler
+ * can filter independent parts of the rows.
+ */
+class Resampler
+{
+private:
+    size_t m_id_column;
+    size_t m_timestamp_column;
+    long m_minutes;
+    bool m_first;
+    std::string m_current_id;
+    long m_current_timestamp;
+
+public:
+    Resampler(size_t id_column, size_t timestamp_column, size_t minutes);
+
+    /**
+     * Whether row goes into the result. Rows have to come in (id, timestamp) order.
+     */
+    bool keep(const Row &row);
+};
+
+#endif
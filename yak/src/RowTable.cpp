@@ -0,0 +1,151 @@
+#include "RowTable.h"
+#include "CSVTokenizer.h"
+#include "SortKey.h"
+
+#include <algorithm>
+
+RowTable::RowTable()
+{
+}
+
+void RowTable::reserve(size_t bytes, size_t rows, size_t fields_per_row)
+{
+    m_bytes.reserve(bytes);
+    m_rows.reserve(rows);
+    m_fields.reserve(rows * fields_per_row);
+}
+
+/**
+ * Reserves every arena for as many more rows like the ones in the table as fit into budget_bytes, counting
+ * scratch_bytes_per_row for sorting on top of every row. Once reserved, has_room() tells when the table is full.
+ *
+ */
+void RowTable::reserve_budget(size_t budget_bytes, size_t scratch_bytes_per_row)
+{
+    if (m_rows.empty())
+    {
+        return;
+    }
+
+    const size_t n = m_rows.size();
+    const size_t row_bytes = (m_bytes.size() + m_fields.size() * sizeof(FieldRef) + m_keys.size()) / n + sizeof(RowRef) + scratch_bytes_per_row;
+    const size_t rows = std::max(budget_bytes / row_bytes, n);
+
+    // Capacities of the whole table, the rows already in it included
+    m_bytes.reserve(m_bytes.size() / n * rows);
+    m_fields.reserve(m_fields.size() / n * rows);
+    m_rows.reserve(rows);
+    m_keys.reserve(m_keys.size() / n * rows);
+}
+
+/**
+ * Whether the line can be appended without growing any arena. A line never parses into more field bytes than it
+ * has or into more fields than it has bytes, and its key is at most about twice its size (see SortKey.h).
+ *
+ */
+bool RowTable::has_room(std::string_view line) const
+{
+    const size_t max_key_bytes = m_key_columns.empty() ? 0 : 2 * line.size() + 13 * m_key_columns.size();
+    return m_rows.size() < m_rows.capacity() &&
+           m_bytes.size() + line.size() <= m_bytes.capacity() &&
+           m_fields.size() + line.size() + 1 <= m_fields.capacity() &&
+           m_keys.size() + max_key_bytes <= m_keys.capacity();
+}
+
+/**
+ * Sets the columns the sort key is built from. Keys of rows already in the table are rebuilt.
+ *
+ */
+void RowTable::set_key_columns(const std::vector<size_t> &columns)
+{
+    if (columns == m_key_columns)
+    {
+        return;
+    }
+
+    m_key_columns = columns;
+    m_keys.clear();
+    for (auto &ref : m_rows)
+    {
+        encode_key(ref);
+    }
+}
+
+const std::vector<size_t> &RowTable::key_columns() const
+{
+    return m_key_columns;
+}
+
+void RowTable::encode_key(RowRef &ref)
+{
+    size_t offset = m_keys.size();
+    SortKey::append(m_keys, row(ref), m_key_columns);
+
+    ref.key_offset = static_cast<uint32_t>(offset);
+    ref.key_length = static_cast<uint32_t>(m_keys.size() - offset);
+    ref.key_prefix = SortKey::prefix(key(ref));
+}
+
+/**
+ * Tokenizes a single CSV line straight into the arena, see CSVTokenizer.
+ *
+ */
+void RowTable::append(std::string_view line)
+{
+    RowRef ref{static_cast<uint32_t>(m_fields.size()), 0, 0, 0, 0};
+    ref.field_count = static_cast<uint32_t>(CSVTokenizer::tokenize(line, m_bytes, m_fields));
+
+    if (!m_key_columns.empty())
+    {
+        encode_key(ref);
+    }
+
+    m_rows.push_back(ref);
+}
+
+void RowTable::clear()
+{
+    m_bytes.clear();
+    m_fields.clear();
+    m_rows.clear();
+    m_keys.clear();
+}
+
+size_t RowTable::size() const
+{
+    return m_rows.size();
+}
+
+bool RowTable::empty() const
+{
+    return m_rows.empty();
+}
+
+/**
+ * Bytes allocated for the parsed rows: field bytes, field index, row index and sort keys, including what the arenas
+ * have reserved beyond the rows in them.
+ *
+ */
+size_t RowTable::memory_usage() const
+{
+    return m_bytes.capacity() + m_fields.capacity() * sizeof(FieldRef) + m_rows.capacity() * sizeof(RowRef) + m_keys.capacity();
+}
+
+Row RowTable::row(const RowRef &ref) const
+{
+    return Row(m_bytes.data(), m_fields.data() + ref.first_field, ref.field_count);
+}
+
+std::string_view RowTable::key(const RowRef &ref) const
+{
+    return std::string_view(m_keys.data() + ref.key_offset, ref.key_length);
+}
+
+bool RowTable::is_smaller(const RowRef &a, const RowRef &b) const
+{
+    if (a.key_prefix != b.key_prefix)
+    {
+        return a.key_prefix < b.key_prefix;
+    }
+    return SortKey::is_smaller(key(a), key(b));
+}
@@ -0,0 +1,52 @@
+#ifndef ROW_TABLE_H
+#define ROW_TABLE_H
+
+#include "CSVDefinitions.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Compact storage for a chunk of CSV rows. The (unquoted) bytes of all fields live in one contiguous arena and
+ * every field is kept as an offset/length pair into it, so a whole chunk costs a handful of allocations instead of
+ * one per field.
+ *
+ * Once key columns are set, every appended row also gets its binary sort key encoded into a second arena, so
+ * sorting compares keys instead of fields. Sorting only ever moves the small RowRef entries, never the bytes.
+ */
+class RowTable
+{
+private:
+    std::string m_bytes;
+    std::vector<FieldRef> m_fields;
+    std::vector<RowRef> m_rows;
+    std::string m_keys;
+    std::vector<size_t> m_key_columns;
+
+private:
+    void encode_key(RowRef &ref);
+
+public:
+    RowTable();
+    void reserve(size_t bytes, size_t rows, size_t fields_per_row);
+    void reserve_budget(size_t budget_bytes, size_t scratch_bytes_per_row);
+    bool has_room(std::string_view line) const;
+    void set_key_columns(const std::vector<size_t> &columns);
+    const std::vector<size_t> &key_columns() const;
+    void append(std::string_view line);
+    void clear();
+    size_t size() const;
+    bool empty() const;
+    size_t memory_usage() const;
+
+    Row row(const RowRef &ref) const;
+    std::string_view key(const RowRef &ref) const;
+    bool is_smaller(const RowRef &a, const RowRef &b) const;
+    Row operator[](size_t i) const { return row(m_rows[i]); }
+
+    std::vector<RowRef> &rows() { return m_rows; }
+    const std::vector<RowRef> &rows() const { return m_rows; }
+};
+
+#endif
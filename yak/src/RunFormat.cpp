@@ -0,0 +1,86 @@
+#include "RunFormat.h"
+
+#include <stdexcept>
+
+namespace RunFormat
+{
+    void append_varint(std::string &out, uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    uint32_t read_varint(const char *&data, const char *end)
+    {
+        uint32_t value = 0;
+        for (size_t i = 0; i < MAX_VARINT_BYTES && data < end; ++i)
+        {
+            unsigned char b = static_cast<unsigned char>(*data++);
+            value |= static_cast<uint32_t>(b & 0x7F) << (7 * i);
+            if ((b & 0x80) == 0)
+            {
+                return value;
+            }
+        }
+        throw std::runtime_error("Run record with a truncated length");
+    }
+
+    /**
+     * Encodes the first num_columns fields of the row, missing ones as empty (like CSV::append_row renders them).
+     *
+     */
+    void append_payload(std::string &payload, const Row &row, size_t num_columns)
+    {
+        append_varint(payload, static_cast<uint32_t>(num_columns));
+        for (size_t i = 0; i < num_columns; ++i)
+        {
+            append_varint(payload, static_cast<uint32_t>(row.has(i) ? row[i].size() : 0));
+        }
+        for (size_t i = 0; i < num_columns && i < row.size(); ++i)
+        {
+            payload.append(row[i]);
+        }
+    }
+
+    void append_record(std::string &out, std::string_view key, std::string_view payload)
+    {
+        append_varint(out, static_cast<uint32_t>(key.size()));
+        append_varint(out, static_cast<uint32_t>(payload.size()));
+        out.append(key);
+        out.append(payload);
+    }
+
+    void append_record(std::string &out, std::string_view key, const Row &row, size_t num_columns)
+    {
+        // The payload length has to be known before the payload is written
+        thread_local std::string payload;
+        payload.clear();
+        append_payload(payload, row, num_columns);
+        append_record(out, key, payload);
+    }
+
+    Row decode_payload(std::string_view payload, std::vector<FieldRef> &fields)
+    {
+        const char *data = payload.data();
+        const char *end = data + payload.size();
+
+        const size_t count = read_varint(data, end);
+        fields.resize(count);
+        uint32_t offset = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            fields[i] = FieldRef{offset, read_varint(data, end)};
+            offset += fields[i].length;
+        }
+
+        if (static_cast<size_t>(end - data) < offset)
+        {
+            throw std::runtime_error("Run record with truncated fields");
+        }
+        return Row(data, fields.data(), count);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef RUN_FORMAT_H
+#define RUN_FORMAT_H
+
+#include "CSVDefinitions.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Binary record format of the sorted runs the sorter spills to disk. All lengths are varints (7 bits per byte, least
+ * significant group first, high bit set on all but the last byte), so short rows don't pay for 4-byte lengths.
+ *
+ *   record:  key length | payload length | key | payload
+ *   payload: field count | field count x field length | field bytes
+ *
+ * The key is the row's SortKey, so merging compares keys without parsing anything, and intermediate merges copy
+ * whole records. The payload holds the unquoted field bytes; CSV is only rendered from it for the final output.
+ */
+namespace RunFormat
+{
+    const size_t MAX_VARINT_BYTES = 5;
+
+    void append_varint(std::string &out, uint32_t value);
+
+    /**
+     * Decodes the varint at data, advancing data past it. Throws if it doesn't end before end.
+     */
+    uint32_t read_varint(const char *&data, const char *end);
+
+    void append_payload(std::string &payload, const Row &row, size_t num_columns);
+    void append_record(std::string &out, std::string_view key, std::string_view payload);
+    void append_record(std::string &out, std::string_view key, const Row &row, size_t num_columns);
+
+    /**
+     * View on the fields of a payload. fields is reused for the field index; the row is valid as long as the
+     * payload bytes and fields are.
+     */
+    Row decode_payload(std::string_view payload, std::vector<FieldRef> &fields);
+}
+
+#endif
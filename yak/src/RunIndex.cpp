@@ -0,0 +1,98 @@
+#include "RunIndex.h"
+#include "SortKey.h"
+
+#include <algorithm>
+#include <iterator>
+
+RunIndex::RunIndex() : m_bytes(0),
+                       m_next_entry(0)
+{
+}
+
+void RunIndex::add(std::string_view key, size_t record_bytes)
+{
+    if (m_bytes >= m_next_entry)
+    {
+        m_entries.push_back(Entry{std::string(key), m_bytes});
+        m_next_entry = m_bytes + INTERVAL_BYTES;
+    }
+    m_bytes += record_bytes;
+}
+
+/**
+ * The last indexed record with a smaller key: every record before it is smaller too, and so is it. From there on at
+ * most INTERVAL_BYTES have to be skipped to get to the key.
+ *
+ */
+uint64_t RunIndex::seek(std::string_view key) const
+{
+    auto it = std::lower_bound(m_entries.begin(), m_entries.end(), key, [](const Entry &entry, std::string_view k)
+                               { return SortKey::is_smaller(entry.key, k); });
+    return it == m_entries.begin() ? 0 : std::prev(it)->offset;
+}
+
+const std::vector<RunIndex::Entry> &RunIndex::entries() const
+{
+    return m_entries;
+}
+
+uint64_t RunIndex::bytes() const
+{
+    return m_bytes;
+}
+
+/**
+ * Every index entry stands for about INTERVAL_BYTES of its run, so in the sorted union of all entries the splitters
+ * are simply evenly spaced.
+ *
+ */
+std::vector<std::string> RunIndex::splitters(const std::vector<const RunIndex *> &indexes, size_t ranges, bool first_column)
+{
+    std::vector<std::string_view> keys;
+    for (const auto *index : indexes)
+    {
+        for (const auto &entry : index->entries())
+        {
+            keys.push_back(first_column ? SortKey::first_column(entry.key) : std::string_view(entry.key));
+        }
+    }
+    std::sort(keys.begin(), keys.end(), SortKey::is_smaller);
+
+    std::vector<std::string> splitters;
+    for (size_t i = 1; i < ranges && !keys.empty(); ++i)
+    {
+        std::string_view key = keys[i * keys.size() / ranges];
+
+        // A range starting at the smallest key would be empty, so would one between equal splitters
+        if (SortKey::is_smaller(keys.front(), key) && (splitters.empty() || SortKey::is_smaller(splitters.back(), key)))
+        {
+            splitters.emplace_back(key);
+        }
+    }
+    return splitters;
+}
+
+void RunIndexes::put(const std::string &run_path, RunIndex &&index)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_indexes[run_path] = std::move(index);
+}
+
+const RunIndex *RunIndexes::find(const std::string &run_path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_indexes.find(run_path);
+    return it == m_indexes.end() ? nullptr : &it->second;
+}
+
+void RunIndexes::remove(const std::string &run_path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_indexes.erase(run_path);
+}
+
+void RunIndexes::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_indexes.clear();
+}
@@ -0,0 +1,79 @@
+#ifndef RUN_INDEX_H
+#define RUN_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Sparse index of a sorted run: the key and file offset of a record about every INTERVAL_BYTES. Built while the
+ * run is written, it lets a merge start reading a run somewhere in the middle, and its keys are an even sample of
+ * the run to pick merge splitters from.
+ *
+ * Offsets are positions in the record stream, which is the file unless the run is compressed.
+ */
+class RunIndex
+{
+public:
+    static constexpr uint64_t INTERVAL_BYTES = 64 * 1024;
+
+    struct Entry
+    {
+        std::string key;
+        uint64_t offset;
+    };
+
+private:
+    std::vector<Entry> m_entries;
+    uint64_t m_bytes;
+    uint64_t m_next_entry;
+
+public:
+    RunIndex();
+
+    /**
+     * Adds the record written next, of record_bytes with the given key, to the index.
+     */
+    void add(std::string_view key, size_t record_bytes);
+
+    /**
+     * Offset of an indexed record that no record with a key of at least key comes before.
+     */
+    uint64_t seek(std::string_view key) const;
+
+    const std::vector<Entry> &entries() const;
+    uint64_t bytes() const;
+
+    /**
+     * Up to ranges - 1 ascending, distinct keys cutting the records of all runs into ranges of about the same
+     * number of bytes. With first_column the keys are cut down to their first column, so all records with the
+     * same first column end up in the same range.
+     */
+    static std::vector<std::string> splitters(const std::vector<const RunIndex *> &indexes, size_t ranges, bool first_column);
+};
+
+/**
+ * The indexes of the runs of a job, by run path. Runs are written on several threads at once.
+ */
+class RunIndexes
+{
+private:
+    std::map<std::string, RunIndex> m_indexes;
+    std::mutex m_mutex;
+
+public:
+    void put(const std::string &run_path, RunIndex &&index);
+
+    /**
+     * The index of the run, nullptr if there is none. Stays valid until the run is removed or the indexes are cleared.
+     */
+    const RunIndex *find(const std::string &run_path);
+    void remove(const std::string &run_path);
+    void clear();
+};
+
+#endif
@@ -5,21 +5,39 @@
 #include <mutex>
 #include <queue>
 
-// A threadsafe-queue.
+// A threadsafe-queue. A queue with a capacity blocks producers while it is full, which gives back-pressure to
+// whoever fills it. A capacity of 0 means unbounded.
 template <typename T>
 class SafeQueue
 {
 public:
-  SafeQueue(void) : m_queue(), m_mutex(), m_cv() {}
+  SafeQueue(size_t capacity = 0) : m_queue(), m_mutex(), m_cv(), m_capacity(capacity) {}
 
   ~SafeQueue(void) {}
 
   // Add an element to the queue.
+  // If the queue is full, wait till there is room.
   void enqueue(T t)
   {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_not_full.wait(lock, [this]()
+                    { return !full(); });
+    m_queue.push(t);
+    m_cv.notify_all();
+  }
+
+  // Same, but gives up after ms. Returns whether t was added.
+  bool enqueue_with_timeout(const int ms, T t)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_not_full.wait_for(lock, std::chrono::milliseconds(ms), [this]()
+                             { return !full(); }))
+    {
+      return false;
+    }
     m_queue.push(t);
     m_cv.notify_all();
+    return true;
   }
 
   // Get the "front"-element.
@@ -34,10 +52,12 @@ public:
     }
     T val = m_queue.front();
     m_queue.pop();
+    m_not_full.notify_one();
     return val;
   }
 
-  void dequeue_with_timeout(const int ms, T &val)
+  // Returns whether an element was taken into val.
+  bool dequeue_with_timeout(const int ms, T &val)
   {
     std::unique_lock<std::mutex> lock(m_mutex);
     m_cv.wait_for(lock, std::chrono::milliseconds(ms), [this]()
@@ -45,11 +65,14 @@ public:
                             bool stop_waiting = !m_queue.empty();
                             return stop_waiting; });
 
-    if (!m_queue.empty())
+    if (m_queue.empty())
     {
-      val = m_queue.front();
-      m_queue.pop();
+      return false;
     }
+    val = m_queue.front();
+    m_queue.pop();
+    m_not_full.notify_one();
+    return true;
   }
 
   size_t size()
@@ -58,9 +81,21 @@ public:
     return m_queue.size();
   }
 
+  size_t capacity() const
+  {
+    return m_capacity;
+  }
+
 private:
   std::queue<T> m_queue;
   mutable std::mutex m_mutex;
   std::condition_variable m_cv;
+  std::condition_variable m_not_full;
+  size_t m_capacity;
+
+  bool full() const
+  {
+    return m_capacity > 0 && m_queue.size() >= m_capacity;
+  }
 };
 #endif
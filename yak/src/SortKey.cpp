@@ -0,0 +1,136 @@
+#include "SortKey.h"
+#include "Util.h"
+
+#include <algorithm>
+
+namespace
+{
+    const char TAG_MISSING = 0x00;
+    const char TAG_NUMBER = 0x01;
+    const char TAG_LONG_NUMBER = 0x02;
+    const char TAG_STRING = 0x03;
+    const size_t MAX_SHORT_NUMBER_DIGITS = 19; // 10^19 - 1 still fits into an uint64_t
+
+    void append_big_endian(std::string &key, uint64_t value, size_t bytes)
+    {
+        for (size_t i = bytes; i > 0; --i)
+        {
+            key.push_back(static_cast<char>((value >> (8 * (i - 1))) & 0xFF));
+        }
+    }
+
+    void append_number(std::string &key, std::string_view digits)
+    {
+        // Leading zeros don't change the value ("007" == "7")
+        size_t first = digits.find_first_not_of('0');
+        digits = first == std::string_view::npos ? std::string_view() : digits.substr(first);
+
+        if (digits.size() <= MAX_SHORT_NUMBER_DIGITS)
+        {
+            uint64_t value = 0;
+            for (char c : digits)
+            {
+                value = value * 10 + static_cast<uint64_t>(c - '0');
+            }
+            key.push_back(TAG_NUMBER);
+            append_big_endian(key, value, 8);
+        }
+        else
+        {
+            // Longer numbers are larger; among them more digits means larger, then digits compare lexicographically
+            key.push_back(TAG_LONG_NUMBER);
+            append_big_endian(key, digits.size(), 4);
+            key.append(digits);
+        }
+    }
+
+    void append_string(std::string &key, std::string_view value)
+    {
+        key.push_back(TAG_STRING);
+        for (char c : value)
+        {
+            key.push_back(c);
+            if (c == '\0')
+            {
+                key.push_back(static_cast<char>(0xFF));
+            }
+        }
+        key.push_back('\0');
+        key.push_back('\0');
+    }
+}
+
+void SortKey::append(std::string &key, const Row &row, const std::vector<size_t> &columns)
+{
+    for (size_t column : columns)
+    {
+        if (!row.has(column))
+        {
+            key.push_back(TAG_MISSING);
+            continue;
+        }
+
+        std::string_view value = row[column];
+        if (Util::is_number(value))
+        {
+            append_number(key, value);
+        }
+        else
+        {
+            append_string(key, value);
+        }
+    }
+}
+
+std::string SortKey::encode(const Row &row, const std::vector<size_t> &columns)
+{
+    std::string key;
+    append(key, row, columns);
+    return key;
+}
+
+std::string_view SortKey::first_column(std::string_view key)
+{
+    if (key.empty())
+    {
+        return key;
+    }
+
+    size_t length = key.size();
+    switch (key[0])
+    {
+    case TAG_MISSING:
+        length = 1;
+        break;
+    case TAG_NUMBER:
+        length = 1 + 8;
+        break;
+    case TAG_LONG_NUMBER:
+        if (key.size() >= 5)
+        {
+            uint64_t digits = 0;
+            for (size_t i = 1; i < 5; ++i)
+            {
+                digits = (digits << 8) | static_cast<unsigned char>(key[i]);
+            }
+            length = 5 + digits;
+        }
+        break;
+    case TAG_STRING:
+        // Ends at the first 0x00 0x00, an escaped 0x00 is followed by 0xFF
+        for (size_t i = 1; i + 1 < key.size(); ++i)
+        {
+            if (key[i] == '\0')
+            {
+                if (key[i + 1] == '\0')
+                {
+                    length = i + 2;
+                    break;
+                }
+                ++i;
+            }
+        }
+        break;
+    }
+    return key.substr(0, std::min(length, key.size()));
+}
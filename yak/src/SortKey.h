@@ -0,0 +1,66 @@
+#ifndef SORT_KEY_H
+#define SORT_KEY_H
+
+#include "CSVDefinitions.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Binary-comparable sort keys. A row's key is built once from its sort columns and afterwards two rows are ordered
+ * by comparing their keys bytewise, without looking at (or parsing) the fields again.
+ *
+ * Every column is encoded as a tag byte followed by its value:
+ *
+ *   0x00                      column missing in the row (sorts first)
+ *   0x01 + 8 bytes BE         number with up to 19 digits
+ *   0x02 + 4 bytes BE + bytes number with more digits (length, then digits)
+ *   0x03 + bytes + 0x00 0x00  anything else; 0x00 inside the value is escaped as 0x00 0xFF
+ *
+ * A number is what Util::is_number accepts (digits only), so numbers compare by value and all of them sort before
+ * strings. This is not the order the old pairwise compare gave columns that mix both, like ids of digits and
+ * letters: it put "10A" before "999", the key puts "999" (a number) before "10A" (a string).
+ */
+namespace SortKey
+{
+    void append(std::string &key, const Row &row, const std::vector<size_t> &columns);
+    std::string encode(const Row &row, const std::vector<size_t> &columns);
+
+    /**
+     * The encoding of the key's first column. All keys with the same first column value start with it and sort
+     * after it.
+     */
+    std::string_view first_column(std::string_view key);
+
+    /**
+     * The first 8 key bytes as a big-endian integer (zero padded). Comparing prefixes orders two keys unless they
+     * are equal, in which case the full keys have to be compared.
+     */
+    inline uint64_t prefix(std::string_view key)
+    {
+        unsigned char bytes[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        std::memcpy(bytes, key.data(), key.size() < 8 ? key.size() : 8);
+
+        uint64_t p = 0;
+        for (unsigned char b : bytes)
+        {
+            p = (p << 8) | b;
+        }
+        return p;
+    }
+
+    inline int compare(std::string_view a, std::string_view b)
+    {
+        return a.compare(b);
+    }
+
+    inline bool is_smaller(std::string_view a, std::string_view b)
+    {
+        return a.compare(b) < 0;
+    }
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef SORT_OPTIONS_H
+#define SORT_OPTIONS_H
+
+#include "IOBackend.h"
+
+#include <cstddef>
+#include <string>
+
+const size_t NUM_THREADS = 4;
+const size_t MEMORY_BUDGET_MB = 256;
+const size_t MAX_FAN_IN = 64;
+
+/**
+ * How the sorted runs that get merged in the end are produced.
+ *
+ * Chunks:               cut the input in budget-sized chunks and sort every chunk in memory on the worker pool.
+ * ReplacementSelection: stream the input through a heap the size of the budget. Runs are about twice the budget on
+ *                       random input and much longer on partly sorted input, so there are fewer runs to merge.
+ */
+enum class RunGeneration
+{
+    Chunks,
+    ReplacementSelection
+};
+
+inline std::string to_string(RunGeneration run_generation)
+{
+    switch (run_generation)
+    {
+    case RunGeneration::ReplacementSelection:
+        return "replacement-selection";
+    case RunGeneration::Chunks:
+    default:
+        return "chunks";
+    }
+}
+
+/**
+ * Whether spilled runs bypass the page cache (O_DIRECT).
+ *
+ * Auto: only when the input of a job is larger than the memory available, as its spills would evict everything
+ *       else long before they are read back.
+ */
+enum class DirectIO
+{
+    Auto,
+    Always,
+    Never
+};
+
+inline std::string to_string(DirectIO direct_io)
+{
+    switch (direct_io)
+    {
+    case DirectIO::Always:
+        return "always";
+    case DirectIO::Never:
+        return "never";
+    case DirectIO::Auto:
+    default:
+        return "auto";
+    }
+}
+
+struct SortOptions
+{
+    size_t num_threads = NUM_THREADS;
+    size_t memory_budget_mb = MEMORY_BUDGET_MB;
+    RunGeneration run_generation = RunGeneration::Chunks;
+    size_t max_fan_in = MAX_FAN_IN;
+    bool compress_runs = false; // spill runs through LZCodec, trading CPU for disk I/O
+    IOEngine io_engine = IOEngine::IOUring;
+    DirectIO direct_io = DirectIO::Auto;
+    size_t concurrent_merges = 0; // batches merged while the runs of the next are generated, 0: one batch at a time
+};
+
+#endif
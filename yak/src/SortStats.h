@@ -0,0 +1,72 @@
+#ifndef SORT_STATS_H
+#define SORT_STATS_H
+
+#include <chrono>
+#include <cstddef>
+#include <sstream>
+#include <string>
+
+/**
+ * What a single Sorter::sort() job did. Logged when the job is done.
+ */
+struct SortStats
+{
+    std::string run_generation;
+    std::string batch_trigger; // what made the ingest loop sort the batch, empty for a plain sort()
+    size_t files = 0;
+    size_t rows = 0;
+    size_t runs = 0;
+    size_t run_bytes = 0;
+    size_t merge_passes = 0;
+    size_t merge_bytes = 0;
+    size_t merge_ranges = 1; // key ranges the final merge was split into
+    bool direct_io = false;
+    std::string codec = "none";
+    size_t spill_raw_bytes = 0;    // runs and intermediate merge outputs before compression
+    size_t spill_stored_bytes = 0; // what they took on disk
+    std::chrono::milliseconds compress_time{0};
+    std::chrono::milliseconds decompress_time{0};
+    bool resampled = false;
+    size_t resampled_rows = 0; // rows resampling kept in the result
+    std::chrono::milliseconds run_generation_time{0};
+    std::chrono::milliseconds merge_time{0};
+
+    std::string to_string() const
+    {
+        std::stringstream ss;
+        ss << "run_generation=" << run_generation;
+        if (!batch_trigger.empty())
+        {
+            ss << ", batch_trigger=" << batch_trigger;
+        }
+        ss << ", files=" << files
+           << ", rows=" << rows
+           << ", runs=" << runs
+           << ", avg_run_rows=" << (runs > 0 ? rows / runs : 0)
+           << ", avg_run_kb=" << (runs > 0 ? run_bytes / runs / 1024 : 0)
+           << ", merge_passes=" << merge_passes
+           << ", merge_mb=" << merge_bytes / (1024 * 1024)
+           << ", merge_ranges=" << merge_ranges
+           << ", direct_io=" << (direct_io ? "yes" : "no")
+           << ", codec=" << codec;
+        if (spill_raw_bytes > 0)
+        {
+            // Negative for incompressible runs: they are stored raw, plus a header per block
+            const double saved_pct = 100.0 * (static_cast<double>(spill_raw_bytes) - static_cast<double>(spill_stored_bytes)) / static_cast<double>(spill_raw_bytes);
+            ss << ", spill_raw_mb=" << spill_raw_bytes / (1024 * 1024)
+               << ", spill_stored_mb=" << spill_stored_bytes / (1024 * 1024)
+               << ", spill_saved_pct=" << static_cast<long long>(saved_pct)
+               << ", compress_ms=" << compress_time.count()
+               << ", decompress_ms=" << decompress_time.count();
+        }
+        if (resampled)
+        {
+            ss << ", resampled_rows=" << resampled_rows;
+        }
+        ss << ", run_generation_ms=" << run_generation_time.count()
+           << ", merge_ms=" << merge_time.count();
+        return ss.str();
+    }
+};
+
+#endif
@@ -1,248 +1,538 @@
 #include "Sorter.h"
+#include "SorterBuilder.h"
+#include "LoserTree.h"
+#include "MappedLineReader.h"
+#include "MergePlanner.h"
+#include "MergeCursor.h"
+#include "ParallelSort.h"
+#include "ReplacementSelection.h"
+#include "RunIndex.h"
 #include "ThreadGuard.h"
 #include "Util.h"
 #include "logging/Logging.h"
 #include <iostream>
 #include <sstream>
 #include <future>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <stdexcept>
 #include <algorithm> // std::min_element
 #include <iterator>  // std::begin, std::end
 #include <unistd.h>  // getpid()
 #include <signal.h>  // kill()
 
-const size_t MAX_CHUNK_SIZE_MB = 10;
-const size_t NUM_THREADS = 4;
-std::vector<std::string> CSV_COLUMNS;
 const std::vector<std::string> COLUMNS_TO_SORT({"id", "timestamp"});
+const size_t MIN_MERGE_BUFFER_BYTES = 64 * 1024;
+const size_t MAX_MERGE_BUFFER_BYTES = 16 * 1024 * 1024;
+const uint64_t MIN_MERGE_RANGE_BYTES = 1024 * 1024;
 
-bool Compare::is_smaller(const Row &ra, const Row &rb, const std::vector<std::string> &attr, size_t i)
+// Rows a chunk is sized from (see RowTable::reserve_budget())
+const size_t CHUNK_SAMPLE_ROWS = 64;
+
+// Share of the memory budget the buffer pool keeps idle direct I/O buffers in for reuse
+const size_t BUFFER_POOL_SHARE = 8;
+
+// Fields and keys of a chunk are found by 32-bit offsets into its arenas (see CSVDefinitions.h), the headroom takes
+// the row that goes over the chunk size
+const size_t MAX_CHUNK_BYTES = size_t(1) << 31;
+
+namespace
 {
-    if (i == attr.size())
+    /*
+    Buffers in use come out of the run generation and merge budgets, the idle ones the pool keeps for the next
+    stream out of a share of their own. Without direct I/O the pool isn't used.
+    */
+    size_t buffer_pool_bytes(const SortOptions &options)
     {
-        return false;
+        const size_t budget_bytes = options.memory_budget_mb * 1024 * 1024;
+        return options.direct_io == DirectIO::Never ? 0 : budget_bytes / BUFFER_POOL_SHARE;
     }
 
-    if (ra.size() == 0)
+    /*
+    Batches sorted one at a time have the whole budget for generating runs, and then again for merging them. When
+    batches are merged while the runs of the next one are generated, run generation gets half of the budget and the
+    concurrent merges share the other half, so the sorter never holds more than the budget.
+    */
+    size_t run_budget_bytes(const SortOptions &options)
     {
-        return true; // Consider an empty row to be "smaller"
-                     // than any non-empty vector.
+        const size_t budget_bytes = options.memory_budget_mb * 1024 * 1024 - buffer_pool_bytes(options);
+        return options.concurrent_merges == 0 ? budget_bytes : budget_bytes / 2;
     }
 
-    if (rb.size() == 0)
+    size_t merge_budget_bytes(const SortOptions &options)
     {
-        return false; // If right side is empty, left can only be equal or larger
+        const size_t budget_bytes = options.memory_budget_mb * 1024 * 1024 - buffer_pool_bytes(options);
+        return options.concurrent_merges == 0 ? budget_bytes : (budget_bytes - budget_bytes / 2) / options.concurrent_merges;
     }
+}
 
-    bool equal;
-    if (Util::is_number(ra.at(attr[i])) && Util::is_number(rb.at(attr[i])))
-    {
-        equal = stod(ra.at(attr[i])) == stod(rb.at(attr[i]));
-    }
-    else
-    {
-        equal = ra.at(attr[i]).compare(rb.at(attr[i])) == 0;
-    }
+Sorter::Sorter(std::shared_ptr<SignalChannel> sig_channel) : Sorter("Sorter", sig_channel, SortOptions())
+{
+}
 
-    if (equal)
-    {
-        return is_smaller(ra, rb, attr, i + 1);
-    }
-    else
+/**
+ * Chunks are sorted on a pool of num_threads workers that lives as long as the sorter. The queue in front of the
+ * workers holds a single chunk, so the splitter can't read further ahead than that.
+ *
+ */
+Sorter::Sorter(std::string name, std::shared_ptr<SignalChannel> sig_channel, const SortOptions &options) : m_name(name),
+                                                                                                           m_sig_channel(sig_channel),
+                                                                                                           m_pool(std::make_shared<ThreadPool>(options.num_threads, 1)),
+                                                                                                           m_options(options),
+                                                                                                           m_run_budget_bytes(run_budget_bytes(options)),
+                                                                                                           m_merge_budget_bytes(merge_budget_bytes(options)),
+                                                                                                           m_codec(options.compress_runs ? std::make_shared<LZCodec>() : nullptr),
+                                                                                                           m_buffer_pool(std::make_shared<AlignedBufferPool>(buffer_pool_bytes(options)))
+{
+    // Process wide, the engine depends on the kernel more than on the sorter
+    IOBackend::set_engine(options.io_engine);
+    m_io = IOBackend::create_shared();
+    if (m_codec)
     {
-        if (Util::is_number(ra.at(attr[i])) && Util::is_number(rb.at(attr[i])))
-        {
-            return stod(ra.at(attr[i])) < stod(rb.at(attr[i]));
-        }
-        else
-        {
-            return ra.at(attr[i]).compare(rb.at(attr[i])) < 0;
-        }
+        // Every run being merged decodes one block ahead, the queue holds a block for each of them
+        m_decode_pool = std::make_unique<ThreadPool>(options.num_threads, options.max_fan_in * (options.num_threads + options.concurrent_merges));
     }
+    Logging::INFO("Sorting with " + std::to_string(m_pool->size()) + " threads, memory budget " + std::to_string(options.memory_budget_mb) + "mb (" + std::to_string(m_run_budget_bytes / 1024) + "kb for run generation, " + std::to_string(m_merge_budget_bytes / 1024) + "kb per merge, " + std::to_string(buffer_pool_bytes(options) / 1024) + "kb for idle I/O buffers), chunks of " + std::to_string(chunk_size_bytes() / 1024) + "kb, run generation " + to_string(options.run_generation) + ", merge fan-in " + std::to_string(options.max_fan_in) + ", run compression " + (m_codec ? m_codec->name() : "none") + ", I/O " + to_string(m_io->engine()) + ", direct I/O " + to_string(options.direct_io), m_name);
 }
 
-// Ascending order sort
-bool Compare::operator()(std::pair<int, std::string> line_a, std::pair<int, std::string> line_b)
+/**
+ * Chunks still queued on the pool point at the codec and buffer pool and call back into the sorter, so the pool is
+ * drained and joined before any other member goes away. The runs of a batch that was never closed are removed then.
+ *
+ */
+Sorter::~Sorter()
 {
-    Row ra = CSV::convert_to_row(line_a.second, CSV_COLUMNS);
-    Row rb = CSV::convert_to_row(line_b.second, CSV_COLUMNS);
-    bool rs = is_smaller(ra, rb, COLUMNS_TO_SORT, 0);
+    m_pool.reset();
+    discard_batch();
+}
 
-    /*
-    Because the priority queue outputs largest elements first,
-    the elements that "come before" are actually output last.
-    */
-    return !rs;
+SorterBuilder Sorter::builder(std::string name)
+{
+    return SorterBuilder(name);
 }
 
-Sorter::Sorter(std::shared_ptr<SignalChannel> sig_channel) : m_sig_channel(sig_channel)
+SortStats Sorter::stats() const
 {
-    m_name = "Sorter";
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    return m_stats;
 }
 
-std::string Sorter::process(const std::string &file_path)
+/**
+ * Parsed size of a single chunk, the scratch memory of sorting it included. Every worker holds one chunk while
+ * sorting it, one more waits in the pool's queue and the splitter fills another one, so the budget is shared by
+ * num_threads + 2 chunks, but no chunk grows past MAX_CHUNK_BYTES.
+ *
+ */
+size_t Sorter::chunk_size_bytes() const
 {
-    std::string sorted_chunk_path = file_path + "_s";
+    return std::min(m_run_budget_bytes / (m_pool->size() + 2), MAX_CHUNK_BYTES);
+}
 
+std::string Sorter::process(CSV &chunk, const std::string &sorted_chunk_path, const SpillOptions &spill)
+{
     std::stringstream ss;
-    ss << "Sorting chunk file '"
-       << file_path
-       << "' and writing to '"
+    ss << "Sorting chunk of "
+       << chunk.size()
+       << " rows and writing to '"
        << sorted_chunk_path
        << "'"
        << std::endl;
     Logging::INFO(ss.str(), m_name);
 
-    CSV csv(file_path);
-
-    csv.sort_in_memory_and_write(COLUMNS_TO_SORT, sorted_chunk_path);
+    chunk.sort_in_memory_and_write_run(COLUMNS_TO_SORT, sorted_chunk_path, spill, m_pool.get());
     return sorted_chunk_path;
 }
 
 /**
- * Writes lines into a .txt file and returns the path to the newly created file. The file gets deleted on exit.
+ * Reads the file in chunks that take up to chunk_bytes once parsed and hands each chunk straight to the worker pool,
+ * which sorts it in memory and writes it as a sorted run. Nothing but the sorted runs ever hits the disk.
+ *
+ * Lines are parsed while reading, so the chunk size reflects what a worker actually holds in memory when it sorts
+ * the chunk (field arena, indices and sort keys as allocated, plus the scratch memory of sorting it) rather than the
+ * size of the raw lines.
  *
  */
-void Sorter::write_chunk(std::string file_path, const std::vector<std::string> &lines)
+std::vector<std::future<std::string>> Sorter::split_and_sort_chunks(size_t chunk_bytes, const std::vector<std::string> &file_paths, const std::string &run_path_prefix, SortBatch &batch)
 {
-    Logging::INFO("Creating tmp file '" + file_path + "'. Writing " + std::to_string(lines.size()) + " lines", m_name);
+    Logging::INFO("Spliting " + std::to_string(file_paths.size()) + " files in chunks of " + std::to_string(chunk_bytes / 1024) + "kb", m_name);
 
-    std::ofstream file(file_path);
+    std::vector<std::future<std::string>> sort_results;
+    size_t file_count = 0;
+    std::vector<std::string> header;
+    std::vector<size_t> key_columns;
+    RowTable chunk;
 
-    if (file.is_open())
+    auto submit_chunk = [&]()
     {
-        for (const auto &line : lines)
+        std::string path = run_path_prefix + "_" + std::to_string(file_count++) + "_s" + SPILL_SUFFIX;
+        batch.stats.rows += chunk.size();
+        CSV csv(header, std::move(chunk));
+
+        // Blocks while the pool's queue is full. Takes the spill options as they are now, files added to the batch
+        // later may still switch it to direct I/O. The future keeps the task around until the run is merged, so
+        // the chunk is moved out of it and freed as soon as its run is written.
+        sort_results.push_back(m_pool->submit([csv = std::move(csv), path, spill = batch.spill, this]() mutable
+                                              {
+                                                  CSV sorted = std::move(csv);
+                                                  return this->process(sorted, path, spill); }));
+
+        chunk = RowTable();
+        chunk.set_key_columns(key_columns);
+    };
+
+    for (const auto &file_path : file_paths)
+    {
+        MappedLineReader in(file_path);
+        std::string_view line;
+        bool first_line = true;
+        while (in.next(line))
         {
-            file << line << std::endl;
+            if (first_line)
+            {
+                // Every file repeats the header, the batch is sorted with the columns of the first one
+                if (header.empty())
+                {
+                    header = CSV::read_row(line);
+                    key_columns = CSV::column_indices(header, COLUMNS_TO_SORT);
+                    chunk.set_key_columns(key_columns);
+                }
+                first_line = false;
+            }
+            else
+            {
+                if (chunk.size() >= CHUNK_SAMPLE_ROWS && !chunk.has_room(line))
+                {
+                    submit_chunk();
+                }
+                chunk.append(line);
+
+                // Sized from the first rows, the arenas never grow past the chunk size afterwards
+                if (chunk.size() == CHUNK_SAMPLE_ROWS)
+                {
+                    chunk.reserve_budget(chunk_bytes, ParallelSort::SCRATCH_BYTES_PER_ROW);
+                }
+            }
+
+            if (chunk.memory_usage() + chunk.size() * ParallelSort::SCRATCH_BYTES_PER_ROW >= chunk_bytes)
+            {
+                submit_chunk();
+            }
         }
-        file.close();
     }
-    else
+
+    if (!chunk.empty())
     {
-        Logging::ERROR("Unable to open file", m_name);
+        submit_chunk();
     }
+
+    return sort_results;
 }
 
 /**
- * Reads the file in chunks of size mb megabytes, sort each chunk and writes it to a temp file.
+ * Spilled runs take about as much space as the input. Once that doesn't fit into the memory available, spills would
+ * only push everything else out of the page cache before being read back.
  *
  */
-std::vector<std::string> Sorter::split_file_in_chunks_of_size(int mb, std::string file_path)
+bool Sorter::use_direct_io(const std::vector<std::string> &file_paths) const
 {
-    Logging::INFO("Spliting file '" + file_path + "' in " + std::to_string(mb) + "mb chunks", m_name);
+    if (m_options.direct_io != DirectIO::Auto)
+    {
+        return m_options.direct_io == DirectIO::Always;
+    }
 
-    std::vector<std::string> paths;
-    int chunk_size_in_bytes = mb * 1024 * 1024;
-    int current_bytes_read = 0;
-    size_t file_count = 0;
-    std::string header;
+    uint64_t input_bytes = 0;
+    for (const auto &file_path : file_paths)
+    {
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(file_path, ec);
+        input_bytes += ec ? 0 : size;
+    }
 
-    std::ifstream in(file_path);
-    std::string line;
-    std::vector<std::string> lines;
-    while (!in.eof())
+    const uint64_t available_bytes = Util::available_memory_bytes();
+    if (input_bytes <= available_bytes)
     {
-        std::getline(in, line);
+        return false;
+    }
+    Logging::INFO("Spilling with direct I/O, the input (" + std::to_string(input_bytes / (1024 * 1024)) + "mb) is larger than the memory available (" + std::to_string(available_bytes / (1024 * 1024)) + "mb)", m_name);
+    return true;
+}
 
-        if (in.bad() || in.fail())
+/**
+ * Input buffers of one merge. The merge budget of a batch is shared by all of its merges that may run at the same
+ * time, every one of them holding fan_in input streams and an output stream.
+ *
+ */
+size_t Sorter::merge_buffer_bytes(size_t concurrent_merges, size_t fan_in) const
+{
+    size_t buffer_bytes = m_merge_budget_bytes / (std::max<size_t>(concurrent_merges, 1) * (fan_in + 1));
+    return std::clamp(buffer_bytes, MIN_MERGE_BUFFER_BYTES, MAX_MERGE_BUFFER_BYTES);
+}
+
+/**
+ * Merges the sorted runs into result_path, never reading more than max_fan_in runs at once. With more runs than
+ * that, the runs are merged in a cascade planned by MergePlanner: the intermediate merges of a pass run in parallel
+ * on the worker pool. The final merge is split into key ranges merged on the pool if it is large enough, and passes
+ * its output through a copy of resampler, unless that is nullptr. Returns the number of rows in the result.
+ *
+ */
+size_t Sorter::merge_sort(SortBatch &batch, const std::vector<std::string> &sorted_chunk_paths, const std::string &result_path, const Resampler *resampler)
+{
+    std::vector<uint64_t> run_bytes;
+    for (const auto &file_path : sorted_chunk_paths)
+    {
+        run_bytes.push_back(std::filesystem::file_size(file_path));
+    }
+
+    const std::vector<MergeStep> steps = MergePlanner::plan(run_bytes, m_options.max_fan_in);
+    const size_t passes = MergePlanner::passes(steps);
+    batch.stats.merge_passes = std::max(batch.stats.merge_passes, passes);
+    batch.stats.merge_bytes += MergePlanner::bytes_moved(steps);
+    if (passes > 1)
+    {
+        Logging::INFO("Merging " + std::to_string(sorted_chunk_paths.size()) + " runs in " + std::to_string(passes) + " passes of at most " + std::to_string(m_options.max_fan_in) + " runs", m_name);
+    }
+
+    // Node ids of the plan: runs first, then the output of every step
+    std::vector<std::string> paths(sorted_chunk_paths);
+    for (const auto &step : steps)
+    {
+        paths.push_back(&step == &steps.back() ? result_path : result_path + "_m" + std::to_string(step.output) + SPILL_SUFFIX);
+        batch.spilled.push_back(paths.back());
+    }
+
+    for (size_t pass = 1; pass <= passes; ++pass)
+    {
+        std::vector<const MergeStep *> pass_steps;
+        for (const auto &step : steps)
         {
-            break;
+            if (step.pass == pass)
+            {
+                pass_steps.push_back(&step);
+            }
         }
 
-        current_bytes_read += line.size();
-
-        if (header.empty())
+        if (pass == passes)
         {
-            header.assign(line);
+            // The final merge is alone in its pass and gets all the memory
+            const MergeStep &step = *pass_steps.front();
+            std::vector<std::string> inputs;
+            for (auto id : step.inputs)
+            {
+                inputs.push_back(paths[id]);
+            }
+            const size_t ranges = merge_ranges(inputs, batch.spill);
+            if (ranges > 1)
+            {
+                return merge_partitioned(batch, inputs, paths[step.output], ranges, resampler);
+            }
+            return merge_runs(inputs, paths[step.output], merge_buffer_bytes(1, step.inputs.size()), true, batch.spill, resampler);
         }
-        else
+
+        const size_t buffer_bytes = merge_buffer_bytes(std::min(pass_steps.size(), m_pool->size()), m_options.max_fan_in);
+        std::vector<std::future<void>> merges;
+        for (const auto *step : pass_steps)
         {
-            lines.emplace_back(line);
+            std::vector<std::string> inputs;
+            for (auto id : step->inputs)
+            {
+                inputs.push_back(paths[id]);
+            }
+            std::string output = paths[step->output];
+            merges.push_back(m_pool->submit([this, inputs, output, buffer_bytes, spill = batch.spill]()
+                                            { merge_runs(inputs, output, buffer_bytes, false, spill, nullptr); }));
         }
 
-        if (current_bytes_read >= chunk_size_in_bytes)
+        // The next pass reads what all of them wrote, and a batch that failed is only cleaned up once none is running
+        std::exception_ptr error;
+        for (auto &merge : merges)
+        {
+            try
+            {
+                merge.get();
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+        }
+        if (error)
         {
-            lines.insert(lines.begin(), header);
-            std::string path = file_path + "_" + std::to_string(file_count++) + "_tmp";
-            write_chunk(path, lines);
-            paths.push_back(path);
-            current_bytes_read = 0;
-            lines.clear();
+            std::rethrow_exception(error);
         }
     }
+    return 0;
+}
 
-    if (!lines.empty())
+/**
+ * Number of key ranges the final merge of these runs is split into: one per MIN_MERGE_RANGE_BYTES of input, up to
+ * one per worker. Ranges need the runs' indexes to start reading in the middle of a run, and compressed runs can't be
+ * entered there at all, so those are merged in one piece.
+ *
+ */
+size_t Sorter::merge_ranges(const std::vector<std::string> &sorted_chunk_paths, const SpillOptions &spill) const
+{
+    if (spill.codec != nullptr || spill.run_indexes == nullptr)
     {
-        lines.insert(lines.begin(), header);
-        std::string path = file_path + "_" + std::to_string(file_count++) + "_tmp";
-        write_chunk(path, lines);
-        paths.push_back(path);
-        current_bytes_read = 0;
-        lines.clear();
+        return 1;
     }
 
-    return paths;
+    uint64_t bytes = 0;
+    for (const auto &file_path : sorted_chunk_paths)
+    {
+        const RunIndex *index = spill.run_indexes->find(file_path);
+        if (index == nullptr)
+        {
+            return 1;
+        }
+        bytes += index->bytes();
+    }
+    return std::clamp<size_t>(bytes / MIN_MERGE_RANGE_BYTES, 1, m_pool->size());
 }
 
-void Sorter::merge_sort(const std::vector<std::string> &sorted_chunk_paths, const std::string &result_path)
+/**
+ * Final merge split into key ranges: splitters are picked from the run indexes, every range is merged into a part
+ * file of its own on the worker pool and the parts are concatenated into the result (Util::concatenate_files). A
+ * range starts reading every run at the indexed record closest to its lower bound.
+ *
+ * A range holds all records with its keys and merges them with the same tie breaks as the merge in one piece, so
+ * the result doesn't change. With resampling ranges are cut between ids, so every range starts with the first row of
+ * an id just as the resampler would have seen it.
+ *
+ */
+size_t Sorter::merge_partitioned(SortBatch &batch, const std::vector<std::string> &sorted_chunk_paths, const std::string &result_path, size_t ranges, const Resampler *resampler)
 {
-    Logging::INFO("Merge sorting " + std::to_string(sorted_chunk_paths.size()) + " chunks to '" + result_path + "'", m_name);
-    std::vector<std::shared_ptr<std::ifstream>> streams;
+    std::vector<const RunIndex *> indexes;
     for (const auto &file_path : sorted_chunk_paths)
     {
-        std::shared_ptr<std::ifstream> in = std::make_shared<std::ifstream>(file_path);
-        streams.push_back(in);
+        indexes.push_back(batch.spill.run_indexes->find(file_path));
     }
 
-    // Skip header first so we don't mess up our sort
-    for (size_t i = 0; i < streams.size(); ++i)
+    // Range r covers keys from bounds[r] up to bounds[r + 1], empty bounds are open
+    std::vector<std::string> bounds = RunIndex::splitters(indexes, ranges, resampler != nullptr);
+    bounds.insert(bounds.begin(), std::string());
+    bounds.push_back(std::string());
+    const size_t count = bounds.size() - 1;
+    batch.stats.merge_ranges = count;
+    Logging::INFO("Merging " + std::to_string(sorted_chunk_paths.size()) + " runs in " + std::to_string(count) + " key ranges", m_name);
+
+    const size_t buffer_bytes = merge_buffer_bytes(std::min(count, m_pool->size()), sorted_chunk_paths.size());
+    std::vector<std::string> parts;
+    std::vector<std::future<size_t>> merges;
+    for (size_t r = 0; r < count; ++r)
     {
-        std::shared_ptr<std::ifstream> in = streams[i];
-        std::string line;
-        std::getline(*in, line);
+        MergeRange range{{}, bounds[r], bounds[r + 1], r == 0};
+        for (const auto *index : indexes)
+        {
+            range.start_offsets.push_back(range.lower.empty() ? 0 : index->seek(range.lower));
+        }
+
+        parts.push_back(result_path + "_p" + std::to_string(r) + SPILL_SUFFIX);
+        batch.spilled.push_back(parts.back());
+        merges.push_back(m_pool->submit([this, sorted_chunk_paths, part = parts.back(), buffer_bytes, spill = batch.spill, resampler, range]()
+                                        { return merge_runs(sorted_chunk_paths, part, buffer_bytes, true, spill, resampler, &range); }));
     }
 
-    std::priority_queue<std::pair<int, std::string>, std::vector<std::pair<int, std::string>>, Compare> min_heap;
-    for (size_t i = 0; i < streams.size(); ++i)
+    // Every range reads the runs, none may still be running when they go
+    size_t rows = 0;
+    std::exception_ptr error;
+    for (auto &merge : merges)
+    {
+        try
+        {
+            rows += merge.get();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+    }
+    for (const auto &file_path : sorted_chunk_paths)
+    {
+        std::remove(file_path.c_str());
+        batch.spill.run_indexes->remove(file_path);
+    }
+    if (error)
     {
-        std::shared_ptr<std::ifstream> in = streams[i];
+        std::rethrow_exception(error);
+    }
 
-        std::string line;
-        std::getline(*in, line);
+    Util::concatenate_files(parts, result_path);
+    return rows;
+}
 
-        if (!in->bad() && !in->fail())
+/**
+ * Merges runs into a run, or with render_csv into the CSV result. Records are compared by their stored keys, the
+ * CSV text of a row is only rendered when it goes into the result. A copy of resampler drops rows on their way into
+ * the result. With a range, only the keys of the range are merged and the inputs are left for the other ranges.
+ * Returns the number of records written.
+ *
+ */
+size_t Sorter::merge_runs(const std::vector<std::string> &sorted_chunk_paths, const std::string &result_path, size_t buffer_bytes, bool render_csv, const SpillOptions &spill, const Resampler *resampler, const MergeRange *range)
+{
+    Logging::INFO("Merge sorting " + std::to_string(sorted_chunk_paths.size()) + " chunks to '" + result_path + "'", m_name);
+    std::vector<std::unique_ptr<MergeCursor>> cursors;
+    std::vector<MergeCursor *> inputs;
+    for (size_t i = 0; i < sorted_chunk_paths.size(); ++i)
+    {
+        cursors.push_back(std::make_unique<MergeCursor>(sorted_chunk_paths[i], buffer_bytes, spill, range ? range->start_offsets[i] : 0));
+        if (range)
         {
-            min_heap.push(std::pair<int, std::string>(i, line));
+            cursors.back()->set_range(range->lower, range->upper);
         }
+        inputs.push_back(cursors.back().get());
     }
 
-    std::ofstream file(result_path);
+    std::optional<Resampler> filter;
+    if (resampler != nullptr)
+    {
+        filter = *resampler;
+    }
 
-    // Write header
-    std::string sep = "";
-    for (const auto &c : COLUMNS_TO_SORT)
+    LoserTree<MergeCursor> tree(inputs);
+
+    // The merge loop only fills buffers. Compressing is left to a background thread, plain buffers are written
+    // double buffered through the I/O backend while the loop fills the next one. The CSV result isn't a spill, so it
+    // is never compressed or written with direct I/O.
+    BufferedWriter file(buffer_bytes, FlushPolicy::WhenFull, !render_csv && spill.codec != nullptr);
+    if (!render_csv)
     {
-        file << sep << c;
-        sep.assign(",");
+        file.set_codec(spill.codec, spill.codec_stats);
+        file.set_direct_io(spill.buffer_pool);
     }
-    file << std::endl;
-    flush(file);
+    file.set_io(spill.io);
+    file.open(result_path);
 
-    while (min_heap.size() > 0)
+    if (render_csv && (range == nullptr || range->first))
+    {
+        // Write header
+        CSV::write_header(file, COLUMNS_TO_SORT);
+    }
+
+    size_t rows = 0;
+    RunIndex index;
+    while (!tree.empty())
     {
-        std::pair<int, std::string> min_pair = min_heap.top();
-        min_heap.pop();
         if (file.is_open())
         {
-            file << min_pair.second << std::endl;
+            if (render_csv)
+            {
+                Row row = tree.top().row();
+                if (!filter || filter->keep(row))
+                {
+                    CSV::write_row(file, row, row.size());
+                    ++rows;
+                }
+            }
+            else
+            {
+                file.write(tree.top().record());
+                index.add(tree.top().key(), tree.top().record().size());
+                ++rows;
+            }
         }
-        flush(file);
 
-        std::string next_line;
-        std::getline(*streams[min_pair.first], next_line);
-        if (!streams[min_pair.first]->bad() && !streams[min_pair.first]->fail())
-        {
-            min_heap.push(std::pair<int, std::string>(min_pair.first, next_line));
-        }
+        tree.pop();
 
         // if (check_exit())
         // {
@@ -251,146 +541,306 @@ void Sorter::merge_sort(const std::vector<std::string> &sorted_chunk_paths, cons
     }
 
     // clean up
-    for (int i = 0; i < streams.size(); i++)
+    for (size_t i = 0; i < cursors.size(); i++)
     {
-        streams[i]->close();
-        std::remove(sorted_chunk_paths[i].c_str());
+        cursors[i]->close();
+        if (range == nullptr)
+        {
+            std::remove(sorted_chunk_paths[i].c_str());
+            if (spill.run_indexes != nullptr)
+            {
+                spill.run_indexes->remove(sorted_chunk_paths[i]);
+            }
+        }
     }
     file.close();
+    if (!render_csv && spill.run_indexes != nullptr)
+    {
+        spill.run_indexes->put(result_path, std::move(index));
+    }
+    return rows;
 }
 
-std::string Sorter::external_sort(const std::string &file_path)
+/**
+ * Turns all files into sorted runs as if they were one input. Chunks may span file boundaries and replacement
+ * selection runs carry on into the next file, so the files yield as few (and as full) runs as possible. Chunks are
+ * still being sorted on the pool when this returns, replacement selection runs are all written.
+ *
+ */
+std::vector<std::future<std::string>> Sorter::generate_runs(const std::vector<std::string> &file_paths, const std::string &run_path_prefix, RunGeneration run_generation, SortBatch &batch)
+{
+    if (run_generation == RunGeneration::ReplacementSelection)
+    {
+        // Inherently sequential, so the heap gets all of run generation's budget
+        std::vector<std::string> header = CSV::read_header(file_paths.front());
+        ReplacementSelection replacement_selection(header, CSV::column_indices(header, COLUMNS_TO_SORT), m_run_budget_bytes);
+        std::vector<std::future<std::string>> runs;
+        for (auto &path : replacement_selection.generate_runs(file_paths, run_path_prefix, batch.spill))
+        {
+            std::promise<std::string> run;
+            run.set_value(std::move(path));
+            runs.push_back(run.get_future());
+        }
+        batch.stats.rows += replacement_selection.rows();
+        return runs;
+    }
+
+    // The splitter moves on to the next file while the pool still sorts chunks of the previous ones
+    return split_and_sort_chunks(chunk_size_bytes(), file_paths, run_path_prefix, batch);
+}
+
+std::string Sorter::sort(std::vector<std::string> files)
+{
+    return sort_batch(files, m_options.run_generation, std::nullopt);
+}
+
+std::string Sorter::sort(std::vector<std::string> files, RunGeneration run_generation)
+{
+    return sort_batch(files, run_generation, std::nullopt);
+}
+
+/**
+ * Sorts the files and resamples the result in the same go (see Resampler), the sorted data itself never hits the
+ * disk. Returns the path of the resampled result.
+ *
+ */
+std::string Sorter::sort_and_resample(std::vector<std::string> files, size_t minutes)
+{
+    return sort_batch(files, m_options.run_generation, minutes);
+}
+
+std::string Sorter::sort_batch(const std::vector<std::string> &files, RunGeneration run_generation, std::optional<size_t> resample_minutes)
 {
     /*
-    1. Put all paths into queue
-    2. Start n fixed number of worker threads
-    3. Sort files in parallel
+    The batch is sorted as a single input:
+    1. Turn all files into sorted runs: either split them into in-memory chunks that get sorted in parallel on the
+       worker pool, or stream them through replacement selection
+    2. Merge all runs into the result in one go, resampling on the way if asked to
     */
 
-    Logging::INFO("External sorting file '" + file_path + "'", m_name);
-    auto tmp_file_paths = split_file_in_chunks_of_size(MAX_CHUNK_SIZE_MB, file_path);
-    Logging::INFO("Split into " + std::to_string(tmp_file_paths.size()) + " chunks", m_name);
+    std::unique_ptr<SortBatch> batch = begin_batch(run_generation);
+    add_files(*batch, files);
+    std::string min = *std::min_element(std::begin(files), std::end(files));
+    std::string max = *std::max_element(std::begin(files), std::end(files));
+    batch->runs = generate_runs(files, Util::remove_extension(min) + "-" + Util::base_name(max), run_generation, *batch);
+    return merge_batch(*batch, resample_minutes);
+}
 
-    std::vector<std::future<std::string>> sort_results;
-    for (const auto &chunk_path : tmp_file_paths)
+/**
+ * Starts generating the runs of file_path while the rest of the batch hasn't arrived yet. Every file is turned into
+ * runs of its own (its chunks don't span into the next file, replacement selection starts over), so the batch may end
+ * up with a few more runs than sort() would make of it. The first file added starts a new batch.
+ *
+ */
+void Sorter::add_to_batch(const std::string &file_path)
+{
+    if (!m_batch)
+    {
+        m_batch = begin_batch(m_options.run_generation);
+    }
+    add_files(*m_batch, {file_path});
+    for (auto &run : generate_runs({file_path}, file_path, m_options.run_generation, *m_batch))
     {
-        std::future<std::string> chunk_fut = std::async(std::launch::async,
-                                                        [chunk_path, this]()
-                                                        {
-                                                            return this->process(chunk_path);
-                                                        });
-        sort_results.push_back(std::move(chunk_fut));
+        m_batch->runs.push_back(std::move(run));
     }
+}
 
-    // Wait for result
-    std::vector<std::string> sorted_chunk_file_paths;
-    for (auto &f : sort_results)
+/**
+ * Ends the batch files were added to and hands it over for merging, the next file added starts a new batch. The
+ * trigger that ended the batch goes into its stats.
+ *
+ */
+std::unique_ptr<SortBatch> Sorter::close_batch(BatchTrigger trigger)
+{
+    if (!m_batch)
     {
-        sorted_chunk_file_paths.emplace_back(f.get());
+        throw std::logic_error("No files in the batch");
     }
+    m_batch->stats.batch_trigger = trigger == BatchTrigger::None ? "" : to_string(trigger);
+    return std::move(m_batch);
+}
 
-    std::string result_path = file_path + "_s";
-    if (sorted_chunk_file_paths.size() == tmp_file_paths.size())
+/**
+ * Gives up on a closed batch that won't be merged, or whose merge failed: waits for the runs still being sorted and
+ * removes them all, along with whatever a failed merge left behind. The files of the batch stay where they are.
+ *
+ */
+void Sorter::discard(SortBatch &batch)
+{
+    for (auto &run : batch.runs)
     {
-        merge_sort(sorted_chunk_file_paths, result_path);
+        // Runs a merge took are in spilled already
+        if (!run.valid())
+        {
+            continue;
+        }
+        try
+        {
+            batch.spilled.push_back(run.get());
+        }
+        catch (...)
+        {
+            // Nothing to remove of a run that failed
+        }
     }
 
-    // Clean up tmp files
-    for (int i = 0; i < tmp_file_paths.size(); i++)
+    size_t removed = 0;
+    for (const auto &path : batch.spilled)
     {
-        std::remove(tmp_file_paths[i].c_str());
+        removed += std::remove(path.c_str()) == 0 ? 1 : 0;
+        batch.spill.run_indexes->remove(path);
     }
+    batch.runs.clear();
+    batch.spilled.clear();
+    Logging::WARN("Dropped a batch of " + std::to_string(batch.files.size()) + " files, removed " + std::to_string(removed) + " spilled files", m_name);
+}
 
-    return result_path;
+/**
+ * Gives up on the batch files were added to, if there is one, like discard() does. Must not race with add_to_batch().
+ *
+ */
+void Sorter::discard_batch()
+{
+    if (m_batch)
+    {
+        std::unique_ptr<SortBatch> batch = std::move(m_batch);
+        discard(*batch);
+    }
 }
 
-std::string Sorter::sort(std::vector<std::string> files)
+/**
+ * Merges the runs of a closed batch, waiting for the ones still being sorted. Returns the path of the result, named
+ * as sort() would name it. Safe to call while files are added to the next batch.
+ *
+ */
+std::string Sorter::merge(SortBatch &batch)
+{
+    return merge_batch(batch, std::nullopt);
+}
+
+/**
+ * Same as merge(), resampling the result on the way (see sort_and_resample()).
+ *
+ */
+std::string Sorter::merge_and_resample(SortBatch &batch, size_t minutes)
+{
+    return merge_batch(batch, minutes);
+}
+
+std::string Sorter::finish_batch(BatchTrigger trigger)
+{
+    return merge(*close_batch(trigger));
+}
+
+std::string Sorter::finish_batch_and_resample(size_t minutes, BatchTrigger trigger)
 {
+    return merge_and_resample(*close_batch(trigger), minutes);
+}
 
-    std::vector<std::string> sorted_files;
-    for (const auto &f : files)
+std::unique_ptr<SortBatch> Sorter::begin_batch(RunGeneration run_generation) const
+{
+    auto batch = std::make_unique<SortBatch>();
+    batch->stats.run_generation = to_string(run_generation);
+    batch->stats.codec = m_codec ? m_codec->name() : "none";
+    batch->codec_stats = std::make_shared<CodecStats>();
+    batch->run_indexes = std::make_shared<RunIndexes>();
+    batch->spill = SpillOptions{m_codec.get(), batch->codec_stats.get(), nullptr, batch->run_indexes.get(), m_io.get(), m_decode_pool.get()};
+    batch->start = std::chrono::steady_clock::now();
+    return batch;
+}
+
+/**
+ * Adds files to the batch. Once the batch no longer fits into memory, runs of the files that follow are spilled with
+ * direct I/O.
+ *
+ */
+void Sorter::add_files(SortBatch &batch, const std::vector<std::string> &file_paths) const
+{
+    batch.files.insert(batch.files.end(), file_paths.begin(), file_paths.end());
+    batch.stats.files = batch.files.size();
+    if (!batch.stats.direct_io && use_direct_io(batch.files))
     {
-        if (CSV_COLUMNS.empty())
-        {
-            CSV_COLUMNS = CSV::read_header(f);
-        }
-        auto f_sorted = external_sort(f);
-        sorted_files.emplace_back(f_sorted);
+        batch.stats.direct_io = true;
+        batch.spill.buffer_pool = m_buffer_pool.get();
     }
+}
 
-    std::string min = *std::min_element(std::begin(files), std::end(files));
-    std::string max = *std::max_element(std::begin(files), std::end(files));
+std::string Sorter::merge_batch(SortBatch &batch, std::optional<size_t> resample_minutes)
+{
+    SortStats &stats = batch.stats;
+    std::vector<std::string> run_paths;
+    for (auto &run : batch.runs)
+    {
+        run_paths.push_back(run.get());
+        batch.spilled.push_back(run_paths.back());
+        stats.run_bytes += std::filesystem::file_size(run_paths.back());
+    }
+    stats.runs = run_paths.size();
+    auto generated = std::chrono::steady_clock::now();
+    Logging::INFO("Generated " + std::to_string(run_paths.size()) + " runs", m_name);
 
+    std::string min = *std::min_element(std::begin(batch.files), std::end(batch.files));
+    std::string max = *std::max_element(std::begin(batch.files), std::end(batch.files));
     std::string result_path = Util::remove_extension(min) + "-" + Util::base_name(max);
-    merge_sort(sorted_files, result_path);
+
+    std::unique_ptr<Resampler> resampler;
+    if (resample_minutes)
+    {
+        // Merged rows keep the columns of the input
+        std::vector<size_t> columns = CSV::column_indices(CSV::read_header(batch.files.front()), COLUMNS_TO_SORT);
+        resampler = std::make_unique<Resampler>(columns[0], columns[1], *resample_minutes);
+        result_path += "_r";
+    }
+    const size_t result_rows = merge_sort(batch, run_paths, result_path, resampler.get());
+
+    const CodecStats &codec_stats = *batch.codec_stats;
+    stats.run_generation_time = std::chrono::duration_cast<std::chrono::milliseconds>(generated - batch.start);
+    stats.merge_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - generated);
+    stats.spill_raw_bytes = codec_stats.raw_bytes;
+    stats.spill_stored_bytes = codec_stats.stored_bytes;
+    stats.compress_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::nanoseconds(codec_stats.compress_ns));
+    stats.decompress_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::nanoseconds(codec_stats.decompress_ns));
+    stats.resampled = resampler != nullptr;
+    stats.resampled_rows = resampler ? result_rows : 0;
+    Logging::INFO("Sorted to '" + result_path + "': " + stats.to_string(), m_name);
+    {
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+        m_stats = stats;
+    }
     return result_path;
 }
 
 /**
- * @brief Assumes file is already sorted
+ * Resamples a file that is already sorted by (id, timestamp) into file_path + "_r". Sorting and resampling in one
+ * go with sort_and_resample() saves writing and reading the sorted file.
  *
- * @param minutes
- * @param file_path
- * @return true
- * @return false
  */
 std::string Sorter::resample_and_write(size_t minutes, const std::string &file_path)
 {
     std::string result_path = file_path + "_r";
-    std::ifstream in(file_path);
-    std::ofstream out(result_path);
-    std::string line;
+    MappedLineReader in(file_path);
+    BufferedWriter out(result_path);
+    std::string_view line;
 
     // Skip header
-    std::getline(in, line);
+    in.next(line);
 
     // Write header
-    out << line << std::endl;
-    flush(out);
+    out.write_line(line);
 
-    // Attempt to read first line
-    std::getline(in, line);
-    if (!in.bad() && !in.fail())
-    {
-        out << line << std::endl;
-
-        Row row = CSV::convert_to_row(line, COLUMNS_TO_SORT);
+    std::vector<size_t> columns = CSV::column_indices(CSV::read_row(line), {"id", "timestamp"});
+    Resampler resampler(columns[0], columns[1], minutes);
+    RowTable table;
 
-        std::string current_id = row.at("id");
-        long current_timestamp = stol(row.at("timestamp"));
-
-        while (!in.eof())
+    while (in.next(line))
+    {
+        if (resampler.keep(CSV::convert_to_row(line, table)))
         {
-            std::getline(in, line);
-
-            if (!in.bad() && !in.fail())
-            {
-                Row row = CSV::convert_to_row(line, COLUMNS_TO_SORT);
-
-                std::string id = row.at("id");
-                long timestamp = stol(row.at("timestamp"));
-                if (id.compare(current_id) != 0)
-                {
-                    // New ID
-                    out << line << std::endl;
-                    flush(out);
-                    current_id = id;
-                    current_timestamp = timestamp;
-                }
-                else
-                {
-                    if (timestamp > current_timestamp + minutes)
-                    {
-                        out << line << std::endl;
-                        flush(out);
-                        current_id = id;
-                        current_timestamp = timestamp;
-                    }
-                }
-            }
+            out.write_line(line);
         }
     }
 
+    out.close();
     return result_path;
 }
 
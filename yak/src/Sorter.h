@@ -1,21 +1,53 @@
 #ifndef WORKER_H
 #define WORKER_H
 
+#include <chrono>
+#include <future>
 #include <string>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <thread>
 #include <vector>
 #include "SafeQueue.h"
 #include "SignalChannel.h"
 #include "CSV.h"
+#include "Resampler.h"
+#include "BatchPolicy.h"
+#include "Codec.h"
+#include "SpillOptions.h"
+#include "SortOptions.h"
+#include "SortStats.h"
+#include "ThreadPool.h"
 
-class Compare
+class SorterBuilder;
+
+/**
+ * Key range of a merge split into ranges: where it starts reading every input and the keys it covers (see
+ * MergeCursor::set_range). Only the first range of the result gets the header.
+ */
+struct MergeRange
 {
-public:
-    bool is_smaller(const Row &ra, const Row &rb, const std::vector<std::string> &attr, size_t i);
+    std::vector<uint64_t> start_offsets;
+    std::string lower;
+    std::string upper;
+    bool first;
+};
 
-    // Ascending order sort
-    bool operator()(std::pair<int, std::string> line_a, std::pair<int, std::string> line_b);
+/**
+ * Files of a batch, their runs and everything the merge needs of them. Batches share no state, so one batch can be
+ * merged while the runs of the next one are generated.
+ */
+struct SortBatch
+{
+    std::vector<std::string> files;
+    std::vector<std::future<std::string>> runs; // some maybe still being sorted
+    std::vector<std::string> spilled;           // files merging took over from runs or wrote, for discard()
+    SortStats stats;
+    std::shared_ptr<CodecStats> codec_stats;
+    std::shared_ptr<RunIndexes> run_indexes;
+    SpillOptions spill;
+    std::chrono::steady_clock::time_point start;
 };
 
 class Sorter
@@ -23,18 +55,54 @@ class Sorter
 private:
     std::string m_name;
     std::shared_ptr<SignalChannel> m_sig_channel;
+    std::shared_ptr<ThreadPool> m_pool;
+    SortOptions m_options;
+    size_t m_run_budget_bytes;   // for generating the runs of a batch
+    size_t m_merge_budget_bytes; // for merging a batch
+    SortStats m_stats; // of the last batch merged
+    mutable std::mutex m_stats_mutex;
+    std::shared_ptr<const Codec> m_codec; // for spilled runs, nullptr if they aren't compressed
+    std::shared_ptr<AlignedBufferPool> m_buffer_pool;
+    std::unique_ptr<IOBackend> m_io; // shared by the readers and writers of all runs
+    std::unique_ptr<ThreadPool> m_decode_pool; // decompresses the runs being merged, nullptr if they aren't compressed
+    std::unique_ptr<SortBatch> m_batch; // files were added to, nullptr if there is none
 
 private:
-    void write_chunk(std::string file_path, const std::vector<std::string> &lines);
-    std::vector<std::string> split_file_in_chunks_of_size(int mb, std::string file_path);
-    void merge_sort(const std::vector<std::string> &sorted_chunk_paths, const std::string &result_path);
-    std::string external_sort(const std::string &file_path);
-    std::string process(const std::string &file_path);
+    size_t chunk_size_bytes() const;
+    bool use_direct_io(const std::vector<std::string> &file_paths) const;
+    std::unique_ptr<SortBatch> begin_batch(RunGeneration run_generation) const;
+    void add_files(SortBatch &batch, const std::vector<std::string> &file_paths) const;
+    std::string merge_batch(SortBatch &batch, std::optional<size_t> resample_minutes);
+    std::vector<std::future<std::string>> split_and_sort_chunks(size_t chunk_bytes, const std::vector<std::string> &file_paths, const std::string &run_path_prefix, SortBatch &batch);
+    size_t merge_buffer_bytes(size_t concurrent_merges, size_t fan_in) const;
+    size_t merge_sort(SortBatch &batch, const std::vector<std::string> &sorted_chunk_paths, const std::string &result_path, const Resampler *resampler);
+    size_t merge_runs(const std::vector<std::string> &sorted_chunk_paths, const std::string &result_path, size_t buffer_bytes, bool render_csv, const SpillOptions &spill, const Resampler *resampler, const MergeRange *range = nullptr);
+    size_t merge_ranges(const std::vector<std::string> &sorted_chunk_paths, const SpillOptions &spill) const;
+    size_t merge_partitioned(SortBatch &batch, const std::vector<std::string> &sorted_chunk_paths, const std::string &result_path, size_t ranges, const Resampler *resampler);
+    std::vector<std::future<std::string>> generate_runs(const std::vector<std::string> &file_paths, const std::string &run_path_prefix, RunGeneration run_generation, SortBatch &batch);
+    std::string process(CSV &chunk, const std::string &sorted_chunk_path, const SpillOptions &spill);
+    std::string sort_batch(const std::vector<std::string> &files, RunGeneration run_generation, std::optional<size_t> resample_minutes);
     bool check_exit();
 
 public:
     Sorter(std::shared_ptr<SignalChannel> sig_channel);
+    Sorter(std::string name, std::shared_ptr<SignalChannel> sig_channel, const SortOptions &options);
+    ~Sorter();
     std::string sort(std::vector<std::string> files);
+    std::string sort(std::vector<std::string> files, RunGeneration run_generation);
+    std::string sort_and_resample(std::vector<std::string> files, size_t minutes);
+    void add_to_batch(const std::string &file_path);
+    std::unique_ptr<SortBatch> close_batch(BatchTrigger trigger = BatchTrigger::None);
+    std::string merge(SortBatch &batch);
+    std::string merge_and_resample(SortBatch &batch, size_t minutes);
+    void discard(SortBatch &batch);
+    void discard_batch();
+    std::string finish_batch(BatchTrigger trigger = BatchTrigger::None);
+    std::string finish_batch_and_resample(size_t minutes, BatchTrigger trigger = BatchTrigger::None);
+    SortStats stats() const;
+
+    friend class SorterBuilder;
+    static SorterBuilder builder(std::string name);
     std::string resample_and_write(size_t minutes, const std::string &file_path);
 };
 
@@ -0,0 +1,86 @@
+#include "SorterBuilder.h"
+#include "Sorter.h"
+
+SorterBuilder::SorterBuilder(std::string name) : m_name(name)
+{
+}
+
+SorterBuilder &SorterBuilder::with_sig_channel(std::shared_ptr<SignalChannel> sc)
+{
+    m_sig_channel = sc;
+    return *this;
+}
+
+SorterBuilder &SorterBuilder::with_threads(size_t num_threads)
+{
+    m_options.num_threads = num_threads;
+    return *this;
+}
+
+SorterBuilder &SorterBuilder::with_memory_budget_mb(size_t mb)
+{
+    m_options.memory_budget_mb = mb;
+    return *this;
+}
+
+SorterBuilder &SorterBuilder::with_run_generation(RunGeneration run_generation)
+{
+    m_options.run_generation = run_generation;
+    return *this;
+}
+
+SorterBuilder &SorterBuilder::with_max_fan_in(size_t max_fan_in)
+{
+    m_options.max_fan_in = max_fan_in;
+    return *this;
+}
+
+SorterBuilder &SorterBuilder::with_compressed_runs(bool compress_runs)
+{
+    m_options.compress_runs = compress_runs;
+    return *this;
+}
+
+SorterBuilder &SorterBuilder::with_io_engine(IOEngine io_engine)
+{
+    m_options.io_engine = io_engine;
+    return *this;
+}
+
+SorterBuilder &SorterBuilder::with_direct_io(DirectIO direct_io)
+{
+    m_options.direct_io = direct_io;
+    return *this;
+}
+
+SorterBuilder &SorterBuilder::with_concurrent_merges(size_t concurrent_merges)
+{
+    m_options.concurrent_merges = concurrent_merges;
+    return *this;
+}
+
+Sorter SorterBuilder::build()
+{
+    if (!m_sig_channel)
+    {
+        throw std::runtime_error("No signal channel provided");
+    }
+
+    if (m_options.num_threads == 0)
+    {
+        throw std::runtime_error("At least one sorting thread must be provided");
+    }
+
+    if (m_options.memory_budget_mb == 0)
+    {
+        throw std::runtime_error("A memory budget must be provided");
+    }
+
+    if (m_options.max_fan_in < 2)
+    {
+        throw std::runtime_error("The merge fan-in must be at least 2");
+    }
+
+    // Returned in place, a sorter can't be moved
+    return Sorter(m_name, m_sig_channel, m_options);
+}
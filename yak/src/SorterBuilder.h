@@ -0,0 +1,30 @@
+#ifndef SORTER_BUILDER_H
+#define SORTER_BUILDER_H
+
+#include "Sorter.h"
+#include "SortOptions.h"
+
+#include <string>
+
+class SorterBuilder
+{
+private:
+    std::string m_name;
+    std::shared_ptr<SignalChannel> m_sig_channel;
+    SortOptions m_options;
+
+public:
+    SorterBuilder(std::string name);
+    SorterBuilder &with_sig_channel(std::shared_ptr<SignalChannel> sc);
+    SorterBuilder &with_threads(size_t num_threads);
+    SorterBuilder &with_memory_budget_mb(size_t mb);
+    SorterBuilder &with_run_generation(RunGeneration run_generation);
+    SorterBuilder &with_max_fan_in(size_t max_fan_in);
+    SorterBuilder &with_compressed_runs(bool compress_runs);
+    SorterBuilder &with_io_engine(IOEngine io_engine);
+    SorterBuilder &with_direct_io(DirectIO direct_io);
+    SorterBuilder &with_concurrent_merges(size_t concurrent_merges);
+    Sorter build();
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef SPILL_OPTIONS_H
+#define SPILL_OPTIONS_H
+
+#include "AlignedBuffer.h"
+#include "Codec.h"
+#include "IOBackend.h"
+#include "RunIndex.h"
+#include "ThreadPool.h"
+
+#include <string>
+
+/** Ends the name of every file spilled next to the input, which the DirectoryPoller never takes for an input. */
+inline const std::string SPILL_SUFFIX = "_inprogress";
+
+/**
+ * How sorted runs (and intermediate merge outputs) go to disk and come back. The same for every run of a job.
+ *
+ * codec:       compress runs in blocks (nullptr: don't), adding to codec_stats if given.
+ * buffer_pool: write and read runs with O_DIRECT through aligned buffers from the pool (nullptr: through the page
+ *              cache). Spilled data is read back once, much later, so caching it only evicts everything else.
+ * run_indexes: where to put a RunIndex of every run written (nullptr: don't index runs).
+ * io:          backend every run is read and written through (nullptr: each reader and writer sets up its own).
+ * decode_pool: decompresses the next block of every compressed run being read (nullptr: on the reading thread).
+ */
+struct SpillOptions
+{
+    const Codec *codec = nullptr;
+    CodecStats *codec_stats = nullptr;
+    AlignedBufferPool *buffer_pool = nullptr;
+    RunIndexes *run_indexes = nullptr;
+    IOBackend *io = nullptr;
+    ThreadPool *decode_pool = nullptr;
+
+    bool direct_io() const { return buffer_pool != nullptr; }
+};
+
+#endif
@@ -0,0 +1,99 @@
+#include "ThreadIOBackend.h"
+
+#include <cerrno>
+#include <unistd.h>
+
+ThreadIOBackend::ThreadIOBackend(size_t num_threads) : m_next_id(0),
+                                                      m_stopping(false)
+{
+    for (size_t i = 0; i < (num_threads > 0 ? num_threads : 1); ++i)
+    {
+        m_threads.emplace_back(&ThreadIOBackend::run, this);
+    }
+}
+
+/**
+ * Everything queued is still done, the buffers of the requests are owned by somebody waiting for this.
+ *
+ */
+ThreadIOBackend::~ThreadIOBackend()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_queued.notify_all();
+    for (auto &t : m_threads)
+    {
+        t.join();
+    }
+}
+
+IOEngine ThreadIOBackend::engine() const
+{
+    return IOEngine::Threads;
+}
+
+uint64_t ThreadIOBackend::submit_read(int fd, char *data, size_t size, uint64_t offset)
+{
+    return submit({0, false, fd, data, size, offset});
+}
+
+uint64_t ThreadIOBackend::submit_write(int fd, const char *data, size_t size, uint64_t offset)
+{
+    return submit({0, true, fd, const_cast<char *>(data), size, offset});
+}
+
+uint64_t ThreadIOBackend::submit(Request request)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        request.id = m_next_id++;
+        m_queue.push_back(request);
+    }
+    m_queued.notify_one();
+    return request.id;
+}
+
+int64_t ThreadIOBackend::wait(uint64_t request)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this, request]()
+                { return m_results.count(request) > 0; });
+    int64_t result = m_results[request];
+    m_results.erase(request);
+    return result;
+}
+
+void ThreadIOBackend::run()
+{
+    while (true)
+    {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_queued.wait(lock, [this]()
+                          { return !m_queue.empty() || m_stopping; });
+            if (m_queue.empty())
+            {
+                return;
+            }
+            request = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        ssize_t n;
+        do
+        {
+            n = request.write ? ::pwrite(request.fd, request.data, request.size, static_cast<off_t>(request.offset))
+                              : ::pread(request.fd, request.data, request.size, static_cast<off_t>(request.offset));
+        } while (n < 0 && errno == EINTR);
+
+        const int64_t result = n < 0 ? -static_cast<int64_t>(errno) : static_cast<int64_t>(n);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_results[request.id] = result;
+        }
+        m_done.notify_all();
+    }
+}
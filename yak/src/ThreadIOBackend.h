@@ -0,0 +1,52 @@
+#ifndef THREAD_IO_BACKEND_H
+#define THREAD_IO_BACKEND_H
+
+#include "IOBackend.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * IOBackend doing the requests in the order they came with pread(2)/pwrite(2) on num_threads threads of its own.
+ */
+class ThreadIOBackend : public IOBackend
+{
+private:
+    struct Request
+    {
+        uint64_t id;
+        bool write;
+        int fd;
+        char *data;
+        size_t size;
+        uint64_t offset;
+    };
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_queued; // for the threads
+    std::condition_variable m_done;   // for the callers of wait()
+    std::deque<Request> m_queue;
+    std::unordered_map<uint64_t, int64_t> m_results;
+    uint64_t m_next_id;
+    bool m_stopping;
+    std::vector<std::thread> m_threads;
+
+private:
+    uint64_t submit(Request request);
+    void run();
+
+public:
+    ThreadIOBackend(size_t num_threads = 1);
+    ~ThreadIOBackend();
+    IOEngine engine() const override;
+    uint64_t submit_read(int fd, char *data, size_t size, uint64_t offset) override;
+    uint64_t submit_write(int fd, const char *data, size_t size, uint64_t offset) override;
+    int64_t wait(uint64_t request) override;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t num_threads, size_t max_queued) : m_max_queued(max_queued > 0 ? max_queued : 1),
+                                                                 m_idle(0),
+                                                                 m_stopping(false)
+{
+    for (size_t i = 0; i < (num_threads > 0 ? num_threads : 1); ++i)
+    {
+        m_threads.emplace_back(&ThreadPool::run, this);
+    }
+}
+
+size_t ThreadPool::size() const
+{
+    return m_threads.size();
+}
+
+/**
+ * Workers currently waiting for a task. Only a hint, it may have changed by the time the caller acts on it.
+ *
+ */
+size_t ThreadPool::idle() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_idle - std::min(m_idle, m_tasks.size());
+}
+
+void ThreadPool::run()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            ++m_idle;
+            m_not_empty.wait(lock, [this]()
+                             { return !m_tasks.empty() || m_stopping; });
+            --m_idle;
+
+            // Drain the queue before stopping
+            if (m_tasks.empty())
+            {
+                return;
+            }
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop();
+        }
+        m_not_full.notify_one();
+
+        // Exceptions end up in the task's future
+        task();
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_not_empty.notify_all();
+    m_not_full.notify_all();
+
+    for (auto &t : m_threads)
+    {
+        if (t.joinable())
+        {
+            t.join();
+        }
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Fixed number of worker threads fed from a bounded task queue.
+ *
+ * submit() blocks while the queue is full, so a producer can never run more than num_threads + max_queued tasks
+ * ahead of the workers. The pool is meant to be long-lived: threads are started once and reused for every task
+ * until the pool is destroyed, which waits for all queued tasks to finish.
+ */
+class ThreadPool
+{
+private:
+    std::vector<std::thread> m_threads;
+    std::queue<std::function<void()>> m_tasks;
+    size_t m_max_queued;
+    size_t m_idle; // workers waiting for a task
+    bool m_stopping;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_not_empty;
+    std::condition_variable m_not_full;
+
+private:
+    void run();
+
+public:
+    ThreadPool(size_t num_threads, size_t max_queued);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t size() const;
+    size_t idle() const;
+
+    template <typename F>
+    std::future<std::invoke_result_t<F>> submit(F &&f)
+    {
+        using R = std::invoke_result_t<F>;
+
+        // std::function needs something copyable, a packaged_task isn't
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        std::future<R> result = task->get_future();
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_not_full.wait(lock, [this]()
+                            { return m_tasks.size() < m_max_queued || m_stopping; });
+            if (m_stopping)
+            {
+                throw std::runtime_error("Cannot submit to a stopping thread pool");
+            }
+            m_tasks.emplace([task]()
+                            { (*task)(); });
+        }
+        m_not_empty.notify_one();
+        return result;
+    }
+
+    /**
+     * Queues f only if a worker is idle to pick it up right away, regardless of the queue bound, and never blocks.
+     * Lets a task that runs on the pool hand parts of its work to otherwise idle workers. Returns false if f wasn't
+     * queued.
+     */
+    template <typename F>
+    bool submit_if_idle(F &&f)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping || m_tasks.size() >= m_idle)
+            {
+                return false;
+            }
+            m_tasks.emplace(std::forward<F>(f));
+        }
+        m_not_empty.notify_one();
+        return true;
+    }
+};
+
+#endif
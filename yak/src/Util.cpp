@@ -1,5 +1,82 @@
 #include "Util.h"
+#include <cerrno>
+#include <cstdint>
 #include <cstring>
+#include <charconv>
+#include <cstdio>
+#include <limits>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h> // sysconf()
+
+namespace
+{
+    const size_t COPY_BUFFER_BYTES = 1024 * 1024;
+
+    /**
+     * Copies size bytes from the start of in to out at out_offset, advancing out_offset. Returns false with errno
+     * set if that failed.
+     *
+     */
+    bool copy_file(int in, int out, uint64_t size, off_t &out_offset)
+    {
+        off_t in_offset = 0;
+#ifdef __linux__
+        // Copied in the kernel, file systems with reflinks just share the blocks
+        while (static_cast<uint64_t>(in_offset) < size)
+        {
+            ssize_t n = copy_file_range(in, &in_offset, out, &out_offset, static_cast<size_t>(size - in_offset), 0);
+            if (n > 0)
+            {
+                continue;
+            }
+            if (n == 0)
+            {
+                return true;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP)
+            {
+                return false;
+            }
+            // Not across these files, copy the rest the plain way
+            break;
+        }
+#endif
+        std::vector<char> buffer(COPY_BUFFER_BYTES);
+        while (static_cast<uint64_t>(in_offset) < size)
+        {
+            ssize_t n = ::pread(in, buffer.data(), buffer.size(), in_offset);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return n == 0;
+            }
+            for (ssize_t written = 0; written < n;)
+            {
+                ssize_t w = ::pwrite(out, buffer.data() + written, static_cast<size_t>(n - written), out_offset);
+                if (w < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (w < 0)
+                {
+                    return false;
+                }
+                written += w;
+                out_offset += w;
+            }
+            in_offset += n;
+        }
+        return true;
+    }
+}
 
 bool Util::str_ends_with(const char *str, const char *suffix)
 {
@@ -104,10 +181,92 @@ unsigned long Util::count_lines(const std::string fname)
     return count;
 }
 
-bool Util::is_number(const std::string &s)
+bool Util::is_number(std::string_view s)
 {
-    std::string::const_iterator it = s.begin();
+    std::string_view::const_iterator it = s.begin();
     while (it != s.end() && std::isdigit(*it))
         ++it;
     return !s.empty() && it == s.end();
-}
\ No newline at end of file
+}
+
+/**
+ * Parses a decimal number without going through a temporary std::string like stod() would.
+ *
+ */
+double Util::to_double(std::string_view s)
+{
+    double value = 0;
+    std::from_chars(s.data(), s.data() + s.size(), value);
+    return value;
+}
+
+/**
+ * Memory that can be had without swapping: MemAvailable (free memory plus what the page cache can give back), or
+ * the free pages where /proc/meminfo doesn't tell. Unlimited if neither is known.
+ *
+ */
+unsigned long long Util::available_memory_bytes()
+{
+    std::ifstream meminfo("/proc/meminfo");
+    std::string line;
+    while (std::getline(meminfo, line))
+    {
+        unsigned long long kb = 0;
+        if (std::sscanf(line.c_str(), "MemAvailable: %llu kB", &kb) == 1)
+        {
+            return kb * 1024;
+        }
+    }
+
+#ifdef _SC_AVPHYS_PAGES
+    long pages = sysconf(_SC_AVPHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (pages > 0 && page_size > 0)
+    {
+        return static_cast<unsigned long long>(pages) * static_cast<unsigned long long>(page_size);
+    }
+#endif
+    return std::numeric_limits<unsigned long long>::max();
+}
+
+/**
+ * Appends all other files to the first one, removes them and renames the first one to result_path.
+ *
+ */
+void Util::concatenate_files(const std::vector<std::string> &file_paths, const std::string &result_path)
+{
+    if (file_paths.empty())
+    {
+        return;
+    }
+
+    int out = ::open(file_paths.front().c_str(), O_WRONLY | O_CLOEXEC);
+    if (out < 0)
+    {
+        throw std::runtime_error("Unable to open '" + file_paths.front() + "': " + std::strerror(errno));
+    }
+    off_t out_offset = ::lseek(out, 0, SEEK_END);
+
+    for (size_t i = 1; i < file_paths.size(); ++i)
+    {
+        int in = ::open(file_paths[i].c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (in < 0 || fstat(in, &st) != 0 || !copy_file(in, out, static_cast<uint64_t>(st.st_size), out_offset))
+        {
+            int error = errno;
+            if (in >= 0)
+            {
+                ::close(in);
+            }
+            ::close(out);
+            throw std::runtime_error("Unable to append '" + file_paths[i] + "' to '" + file_paths.front() + "': " + std::strerror(error));
+        }
+        ::close(in);
+        std::remove(file_paths[i].c_str());
+    }
+
+    if (::close(out) != 0 || std::rename(file_paths.front().c_str(), result_path.c_str()) != 0)
+    {
+        throw std::runtime_error("Unable to write '" + result_path + "': " + std::strerror(errno));
+    }
+}
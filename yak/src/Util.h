@@ -2,6 +2,8 @@
 #define UTILS_H
 
 #include <string>
+#include <string_view>
+#include <vector>
 #include <exception>
 #include <stdexcept>
 #include <set>
@@ -19,7 +21,10 @@ namespace Util
     std::string what(const std::exception_ptr &eptr);
     std::set<int> split(const std::string &str, char sep);
     unsigned long count_lines(const std::string fname);
-    bool is_number(const std::string &s);
+    bool is_number(std::string_view s);
+    double to_double(std::string_view s);
+    unsigned long long available_memory_bytes();
+    void concatenate_files(const std::vector<std::string> &file_paths, const std::string &result_path);
 
     template <typename T>
     inline std::string to_string(const std::set<T> &s)
@@ -2,12 +2,14 @@
 #include "ThreadGuard.h"
 
 static std::string name = "LogProcessor";
-SafeQueue<std::string> log_queue;
+MPMCQueue<std::string> log_queue(LOG_QUEUE_CAPACITY);
+std::atomic<uint64_t> log_dropped{0};
 
 Logging::LogProcessor::LogProcessor(std::atomic<size_t> *active_processors, std::condition_variable *log_cv, std::mutex *log_cv_mutex) : m_active_processors(active_processors),
                                                                                                                                          m_log_cv(log_cv),
                                                                                                                                          m_log_cv_mutex(log_cv_mutex)
 {
+    m_batch.reserve(BATCH_LINES);
     // Logging::configure({{"type", "file"}, {"file_name", "yak.log"}, {"reopen_interval", "1"}});
     Logging::configure({{"type", "std_out"}});
     // Logging::configure({{"type", "daily"}, {"file_name", "logs/yak.log"}, {"hour", "2"}, {"minute", "30"}});
@@ -26,7 +28,6 @@ void Logging::LogProcessor::join() const
 
 void Logging::LogProcessor::run()
 {
-    m_should_run = true;
     while (m_should_run)
     {
         // Do not log when we have active processors. Processors have priority over logging.
@@ -60,29 +61,66 @@ void Logging::LogProcessor::run()
 
         /*
         Read and log
-        Important: after unlocking as we don't want to block strategies while waiting for dequeue if queue is empty
+        Important: after unlocking as we don't want to block strategies while waiting for dequeue if queue is empty.
+        The wait ends as soon as a line is queued, so there is no need to sleep in between.
         */
-        std::string message;
-        log_queue.dequeue_with_timeout(1000, message);
-        if (!message.empty())
-        {
-            Logging::log(message);
-        }
-
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        drain(WAIT_MS);
     } // end while
 
     Logging::log("Shutdown requested. Processing remaining " + std::to_string(log_queue.size()) + " messages...", Logging::Level::INFO, name);
-    std::string msg;
-    log_queue.dequeue_with_timeout(1000, msg);
-    while (!msg.empty())
+    while (drain(0) > 0)
+    {
+    }
+
+    LogStats s = stats();
+    Logging::log("Shutting down. Wrote " + std::to_string(s.written) + " messages, dropped " + std::to_string(s.dropped) +
+                     ", max queue depth " + std::to_string(s.max_queue_depth),
+                 Logging::Level::INFO, name);
+}
+
+/*
+Takes up to BATCH_LINES lines off the queue, waiting up to wait_ms for the first one, and hands them to the logger in
+one go, so a burst of lines costs one write and flush instead of one per line. Lines dropped since the last call are
+reported in the same batch. Returns the number of lines taken off the queue.
+*/
+size_t Logging::LogProcessor::drain(int wait_ms)
+{
+    m_batch.clear();
+    size_t lines = log_queue.dequeue_n_with_timeout(wait_ms, m_batch, BATCH_LINES);
+
+    // What was waiting when the batch was taken
+    size_t depth = lines + log_queue.size();
+    if (depth > m_max_queue_depth.load(std::memory_order_relaxed))
     {
-        Logging::log(msg, Logging::Level::INFO);
-        msg.clear();
-        log_queue.dequeue_with_timeout(1000, msg);
+        m_max_queue_depth.store(depth, std::memory_order_relaxed);
     }
 
-    Logging::log("Shutting down", Logging::Level::INFO, name);
+    uint64_t dropped = log_dropped.load(std::memory_order_relaxed);
+    if (dropped > m_reported_dropped)
+    {
+        m_batch.push_back(create_log("Queue full, dropped " + std::to_string(dropped - m_reported_dropped) +
+                                         " messages (" + std::to_string(dropped) + " in total, queue depth " +
+                                         std::to_string(depth) + ")",
+                                     Level::WARN, name));
+        m_reported_dropped = dropped;
+    }
+
+    if (!m_batch.empty())
+    {
+        Logging::log_batch(m_batch);
+    }
+    m_written.fetch_add(lines, std::memory_order_relaxed);
+    return lines;
+}
+
+Logging::LogStats Logging::LogProcessor::stats() const
+{
+    LogStats s;
+    s.queue_depth = log_queue.size();
+    s.max_queue_depth = m_max_queue_depth.load(std::memory_order_relaxed);
+    s.written = m_written.load(std::memory_order_relaxed);
+    s.dropped = log_dropped.load(std::memory_order_relaxed);
+    return s;
 }
 
 void Logging::LogProcessor::stop()
@@ -6,7 +6,7 @@
 #define LOGGING_H
 #define LOGGING_LEVEL_INFO
 
-#include "../SafeQueue.h"
+#include "../MPMCQueue.h"
 #include <string>
 #include <stdexcept>
 #include <iostream>
@@ -15,6 +15,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <unordered_map>
+#include <vector>
 #include <memory>
 #include <chrono>
 #include <ctime>
@@ -23,7 +24,12 @@
 #include <atomic>
 #include <spdlog/spdlog.h>
 
-extern SafeQueue<std::string> log_queue;
+/** Log lines waiting for the LogProcessor. Every thread that logs writes to it. */
+const size_t LOG_QUEUE_CAPACITY = 64 * 1024;
+extern MPMCQueue<std::string> log_queue;
+
+/** Log lines dropped because log_queue was full. */
+extern std::atomic<uint64_t> log_dropped;
 
 namespace Logging
 {
@@ -102,6 +108,22 @@ namespace Logging
         virtual void log(const std::string &, const Level, const std::string &name){};
         virtual void log(const std::string &message, const Level level){};
         virtual void log(const std::string &){};
+
+        /**
+         * Logs lines made by create_log(). One write for all of them, unless a logger knows better.
+         */
+        virtual void log_batch(const std::vector<std::string> &lines)
+        {
+            std::string buffer;
+            for (const std::string &line : lines)
+            {
+                buffer.append(line);
+            }
+            if (!buffer.empty())
+            {
+                log(buffer);
+            }
+        }
     };
 
     /**
@@ -148,6 +170,7 @@ namespace Logging
         virtual void log(const std::string &message, const Level level, const std::string &name);
         virtual void log(const std::string &message, const Level level) override;
         virtual void log(const std::string &message);
+        virtual void log_batch(const std::vector<std::string> &lines) override;
 
     protected:
         std::string m_file_name;
@@ -205,6 +228,22 @@ namespace Logging
         return output;
     }
 
+    /**
+     * Hands a log line to the LogProcessor. Logging never holds up the caller: with the queue full the line is
+     * dropped and counted, errors excepted.
+     */
+    inline void enqueue_log(std::string line, const Level level)
+    {
+        if (level == Level::ERROR)
+        {
+            log_queue.enqueue(std::move(line));
+        }
+        else if (!log_queue.try_enqueue(std::move(line)))
+        {
+            log_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
     // statically log
     inline void log(const std::string &message, const Level level, const std::string &name)
     {
@@ -222,6 +261,11 @@ namespace Logging
         get_logger().log(message);
     }
 
+    inline void log_batch(const std::vector<std::string> &lines)
+    {
+        get_logger().log_batch(lines);
+    }
+
     inline void TRACE(const std::string &message, const std::string &name = "")
     {
         if (LEVEL_CUTOFF > Level::TRACE)
@@ -229,7 +273,7 @@ namespace Logging
             return;
         }
 
-        log_queue.enqueue(create_log(message, Level::TRACE, name));
+        enqueue_log(create_log(message, Level::TRACE, name), Level::TRACE);
     }
 
     inline void DEBUG(const std::string &message, const std::string &name = "")
@@ -239,7 +283,7 @@ namespace Logging
             return;
         }
 
-        log_queue.enqueue(create_log(message, Level::DEBUG, name));
+        enqueue_log(create_log(message, Level::DEBUG, name), Level::DEBUG);
     }
 
     inline void INFO(const std::string &message, const std::string &name = "")
@@ -250,7 +294,7 @@ namespace Logging
             return;
         }
 
-        log_queue.enqueue(create_log(message, Level::INFO, name));
+        enqueue_log(create_log(message, Level::INFO, name), Level::INFO);
     }
 
     inline void WARN(const std::string &message, const std::string &name = "")
@@ -260,28 +304,50 @@ namespace Logging
             return;
         }
 
-        log_queue.enqueue(create_log(message, Level::WARN, name));
+        enqueue_log(create_log(message, Level::WARN, name), Level::WARN);
     }
 
-    // TODO: Give LogProccessor priority on ERROR so that we don't miss any errors
     inline void ERROR(const std::string &message, const std::string &name = "")
     {
-        log_queue.enqueue(create_log(message, Level::ERROR, name));
+        enqueue_log(create_log(message, Level::ERROR, name), Level::ERROR);
     }
 
     /**
-     * Thread that picks up log events from the queue and actually logs them.
+     * What the LogProcessor did so far.
+     **/
+    struct LogStats
+    {
+        size_t queue_depth = 0;     // lines waiting right now
+        size_t max_queue_depth = 0; // most lines ever found waiting
+        uint64_t written = 0;
+        uint64_t dropped = 0; // because the queue was full
+    };
+
+    /**
+     * Thread that picks up log events from the queue and actually logs them. Lines are taken off the queue in
+     * batches and written in one go, the thread sleeps on the queue while it is empty.
      *
      **/
     class LogProcessor
     {
     private:
-        bool m_should_run;
+        /** Most lines written in one go. */
+        static constexpr size_t BATCH_LINES = 1024;
+
+        /** Longest wait for lines before checking whether to stop. */
+        static constexpr int WAIT_MS = 100;
+
+        std::atomic<bool> m_should_run{true};
         std::unique_ptr<std::thread> m_t;
         std::atomic<size_t> *m_active_processors;
         std::condition_variable *m_log_cv;
         std::mutex *m_log_cv_mutex;
+        std::atomic<size_t> m_max_queue_depth{0};
+        std::atomic<uint64_t> m_written{0};
+        uint64_t m_reported_dropped = 0;
+        std::vector<std::string> m_batch;
         void run();
+        size_t drain(int wait_ms);
 
     public:
         LogProcessor(std::atomic<size_t> *active_processors, std::condition_variable *log_cv, std::mutex *log_cv_mutex);
@@ -289,6 +355,7 @@ namespace Logging
         bool start();
         void join() const;
         void stop();
+        LogStats stats() const;
     };
 
 } // end namespace
@@ -57,4 +57,16 @@ void Logging::SpdLogger::log(const std::string &message, const Level level)
 void Logging::SpdLogger::log(const std::string &message)
 {
     m_logger->trace(message);
+}
+
+/**
+ * A record per line, spdlog would take all of them for a single message.
+ *
+ */
+void Logging::SpdLogger::log_batch(const std::vector<std::string> &lines)
+{
+    for (const std::string &line : lines)
+    {
+        log(line);
+    }
 }
\ No newline at end of file
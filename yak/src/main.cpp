@@ -3,6 +3,9 @@
 #include "ArgParser.h"
 #include "SafeQueue.h"
 #include "Sorter.h"
+#include "SorterBuilder.h"
+#include "BatchPolicy.h"
+#include "PipelineStage.h"
 #include "Version.h"
 #include "PollResult.h"
 #include "PollerBridge.h"
@@ -27,6 +30,7 @@
 #include <cstdlib>
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 
 #include <signal.h>
@@ -36,6 +40,12 @@
 
 static const std::string name = "main";
 
+/** Closed batches waiting to be merged. One waits while another is merged, after that the split stage holds off. */
+const size_t MERGE_QUEUE_CAPACITY = 1;
+
+/** Results waiting to be committed. */
+const size_t COMMIT_QUEUE_CAPACITY = 16;
+
 class FilePathCompare
 {
     // Ascending order sort
@@ -47,10 +57,23 @@ class FilePathCompare
 
 void print_usage(const std::string &name)
 {
-    std::cout << "usage: " << name << " [-h] [-d <directory>]"
+    std::cout << "usage: " << name << " [-h] [-d <directory>] [-t <threads>] [-m <megabytes>] [-r <chunks|replacement-selection>] [-f <fan-in>] [-c] [-i <io_uring|threads>] [-o <auto|always|never>] [-n <files>] [-s <megabytes>] [-w <seconds>] [-q <files>] [-p <merges>]"
               << "\n"
               << "Compare:\n"
               << "  -d    directory to read\n"
+              << "  -t    number of sorting threads (default: 4)\n"
+              << "  -m    sort memory budget in megabytes, split between run generation and the merges (default: 256)\n"
+              << "  -r    run generation: chunks or replacement-selection (default: chunks)\n"
+              << "  -f    maximum number of runs merged at once (default: 64)\n"
+              << "  -c    compress sorted runs spilled to disk\n"
+              << "  -i    asynchronous I/O: io_uring or threads (default: io_uring, threads where it isn't available)\n"
+              << "  -o    spill runs with O_DIRECT: auto (input larger than available memory), always or never (default: auto)\n"
+              << "Batches, sorted once any limit is reached (0: no limit):\n"
+              << "  -n    maximum number of files in a batch (default: 10)\n"
+              << "  -s    maximum size of a batch in megabytes (default: 0)\n"
+              << "  -w    maximum seconds a batch waits for more files after the first one arrived (default: 0)\n"
+              << "  -q    sort the batch early once this many files wait in the queue behind it (default: 0)\n"
+              << "  -p    number of batches merged at the same time (default: 1)\n"
               << "Miscellaneous:\n"
               << "  -h    display this help text and exit\n"
               << "Example:\n"
@@ -174,6 +197,185 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    size_t num_threads = NUM_THREADS;
+    std::vector<std::string> threads = args.option("-t");
+    if (!threads.empty())
+    {
+        try
+        {
+            num_threads = std::stoul(threads[0]);
+        }
+        catch (...)
+        {
+            std::cerr << "Invalid number of threads '" << threads[0] << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    size_t memory_budget_mb = MEMORY_BUDGET_MB;
+    std::vector<std::string> memory = args.option("-m");
+    if (!memory.empty())
+    {
+        try
+        {
+            memory_budget_mb = std::stoul(memory[0]);
+        }
+        catch (...)
+        {
+            std::cerr << "Invalid memory budget '" << memory[0] << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    RunGeneration run_generation = RunGeneration::Chunks;
+    std::vector<std::string> run_generation_option = args.option("-r");
+    if (!run_generation_option.empty())
+    {
+        if (run_generation_option[0] == to_string(RunGeneration::ReplacementSelection))
+        {
+            run_generation = RunGeneration::ReplacementSelection;
+        }
+        else if (run_generation_option[0] != to_string(RunGeneration::Chunks))
+        {
+            std::cerr << "Invalid run generation '" << run_generation_option[0] << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    size_t max_fan_in = MAX_FAN_IN;
+    std::vector<std::string> fan_in = args.option("-f");
+    if (!fan_in.empty())
+    {
+        try
+        {
+            max_fan_in = std::stoul(fan_in[0]);
+        }
+        catch (...)
+        {
+            std::cerr << "Invalid fan-in '" << fan_in[0] << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    bool compress_runs = args.has_option("-c");
+
+    IOEngine io_engine = IOEngine::IOUring;
+    std::vector<std::string> io_engine_option = args.option("-i");
+    if (!io_engine_option.empty())
+    {
+        if (io_engine_option[0] == to_string(IOEngine::Threads))
+        {
+            io_engine = IOEngine::Threads;
+        }
+        else if (io_engine_option[0] != to_string(IOEngine::IOUring))
+        {
+            std::cerr << "Invalid I/O engine '" << io_engine_option[0] << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    DirectIO direct_io = DirectIO::Auto;
+    std::vector<std::string> direct_io_option = args.option("-o");
+    if (!direct_io_option.empty())
+    {
+        if (direct_io_option[0] == to_string(DirectIO::Always))
+        {
+            direct_io = DirectIO::Always;
+        }
+        else if (direct_io_option[0] == to_string(DirectIO::Never))
+        {
+            direct_io = DirectIO::Never;
+        }
+        else if (direct_io_option[0] != to_string(DirectIO::Auto))
+        {
+            std::cerr << "Invalid direct I/O mode '" << direct_io_option[0] << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    BatchOptions batch_options;
+    std::vector<std::string> batch_files = args.option("-n");
+    if (!batch_files.empty())
+    {
+        try
+        {
+            batch_options.max_files = std::stoul(batch_files[0]);
+        }
+        catch (...)
+        {
+            std::cerr << "Invalid number of files per batch '" << batch_files[0] << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::string> batch_size = args.option("-s");
+    if (!batch_size.empty())
+    {
+        try
+        {
+            batch_options.max_bytes = std::stoull(batch_size[0]) * 1024 * 1024;
+        }
+        catch (...)
+        {
+            std::cerr << "Invalid batch size '" << batch_size[0] << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::string> batch_wait = args.option("-w");
+    if (!batch_wait.empty())
+    {
+        try
+        {
+            batch_options.max_wait = std::chrono::seconds(std::stoul(batch_wait[0]));
+        }
+        catch (...)
+        {
+            std::cerr << "Invalid batch wait '" << batch_wait[0] << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::string> queue_watermark = args.option("-q");
+    if (!queue_watermark.empty())
+    {
+        try
+        {
+            batch_options.queue_watermark = std::stoul(queue_watermark[0]);
+        }
+        catch (...)
+        {
+            std::cerr << "Invalid queue watermark '" << queue_watermark[0] << "'." << std::endl;
+            return 1;
+        }
+    }
+
+    size_t merge_threads = 1;
+    std::vector<std::string> merges = args.option("-p");
+    if (!merges.empty())
+    {
+        try
+        {
+            merge_threads = std::stoul(merges[0]);
+        }
+        catch (...)
+        {
+            std::cerr << "Invalid number of merges '" << merges[0] << "'." << std::endl;
+            return 1;
+        }
+    }
+    if (merge_threads == 0)
+    {
+        std::cerr << "At least one batch must be merged at a time." << std::endl;
+        return 1;
+    }
+
+    if (batch_options.max_files == 0 && batch_options.max_bytes == 0 && batch_options.max_wait.count() == 0 && batch_options.queue_watermark == 0)
+    {
+        std::cerr << "Please limit batches by files, size, wait or queue watermark." << std::endl;
+        return 1;
+    }
+
     /*************************************************************************
      *
      * SIGINT CHANNEL
@@ -222,38 +424,119 @@ int main(int argc, char **argv)
 
     /*************************************************************************
      *
-     * MAIN LOOP
+     * PIPELINE
      *
      *************************************************************************/
 
-    std::vector<std::string> files;
-    while (true)
+    // The sorter (and its worker pool) is reused for every batch
+    Sorter s = Sorter::builder("Sorter")
+                   .with_sig_channel(sig_channel)
+                   .with_threads(num_threads)
+                   .with_memory_budget_mb(memory_budget_mb)
+                   .with_run_generation(run_generation)
+                   .with_max_fan_in(max_fan_in)
+                   .with_compressed_runs(compress_runs)
+                   .with_io_engine(io_engine)
+                   .with_direct_io(direct_io)
+                   .with_concurrent_merges(merge_threads)
+                   .build();
+
+    /*
+    ingest (DirectoryPoller) -> split -> run sort (the sorter's pool) -> merge and resample -> commit
+
+    Files are split into chunks as they arrive and the chunks are sorted into runs on the sorter's pool, which holds
+    back the split stage while its queue is full. The split stage also closes batches (see BatchPolicy). Merging a
+    closed batch only reads its runs, so batch N is merged while the runs of batch N + 1 are generated. Resampling
+    happens in the final merge, the sorted batch is never written.
+    */
+    auto batches_queue = std::make_shared<SafeQueue<std::shared_ptr<SortBatch>>>(MERGE_QUEUE_CAPACITY);
+    auto results_queue = std::make_shared<SafeQueue<std::string>>(COMMIT_QUEUE_CAPACITY);
+    BatchPolicy batch_policy(batch_options);
+
+    auto split = [&](std::optional<PollResult> file) -> std::optional<std::shared_ptr<SortBatch>>
     {
-        PollResult r;
-        files_to_sort_queue->dequeue_with_timeout(1000, r);
-        if (!r.empty())
+        if (file)
         {
-            std::string file_path = r.get();
-            files.emplace_back(file_path);
-            if (files.size() == 10)
-            {
-                Sorter s(sig_channel);
-                const auto &sorted_file_path = s.sort(files);
-                files.clear();
-                const auto resampled_file_path = s.resample_and_write(15, sorted_file_path);
-                std::remove(sorted_file_path.c_str());
-                std::string new_resampled_file_path = resampled_file_path + ".csv";
-                std::rename(resampled_file_path.c_str(), new_resampled_file_path.c_str());
-                std::cout << "Resampled to:" << new_resampled_file_path << std::endl;
-            }
+            s.add_to_batch(file->get());
+            batch_policy.add(file->get());
+        }
+
+        BatchTrigger trigger = batch_policy.check(files_to_sort_queue->size());
+        if (trigger == BatchTrigger::None)
+        {
+            return std::nullopt;
         }
+        batch_policy.reset();
+        return std::shared_ptr<SortBatch>(s.close_batch(trigger));
+    };
+
+    auto merge = [&s](std::optional<std::shared_ptr<SortBatch>> batch) -> std::optional<std::string>
+    {
+        if (!batch)
+        {
+            return std::nullopt;
+        }
+        return s.merge_and_resample(**batch, 15);
+    };
+
+    // A batch that can't be merged anymore, or failed to merge, leaves no runs behind
+    auto drop_batch = [&s](std::shared_ptr<SortBatch> &batch)
+    {
+        s.discard(*batch);
+    };
 
-        if (should_exit(sig_channel))
+    auto commit = [](std::optional<std::string> resampled_file_path) -> std::optional<std::string>
+    {
+        if (resampled_file_path)
         {
-            break;
+            std::string new_resampled_file_path = *resampled_file_path + ".csv";
+            std::rename(resampled_file_path->c_str(), new_resampled_file_path.c_str());
+            std::cout << "Resampled to:" << new_resampled_file_path << std::endl;
         }
+        return std::nullopt;
+    };
+
+    // A file the split stage failed on leaves the batch it went into incomplete
+    auto discard_file = [&s, &batch_policy](PollResult &)
+    {
+        s.discard_batch();
+        batch_policy.reset();
+    };
+
+    // A merged result is complete, it is committed even if the commit stage is gone
+    auto drop_result = [&commit](std::string &resampled_file_path)
+    {
+        commit(resampled_file_path);
+    };
+
+    PipelineStage<PollResult, std::shared_ptr<SortBatch>> split_stage("Split", sig_channel, 1, files_to_sort_queue, batches_queue, split, drop_batch, discard_file);
+    PipelineStage<std::shared_ptr<SortBatch>, std::string> merge_stage("Merge", sig_channel, merge_threads, batches_queue, results_queue, merge, drop_result, drop_batch);
+    PipelineStage<std::string, std::string> commit_stage("Commit", sig_channel, 1, results_queue, nullptr, commit);
+
+    split_stage.start();
+    merge_stage.start();
+    commit_stage.start();
+
+    while (!should_exit(sig_channel))
+    {
     }
 
+    split_stage.join();
+    merge_stage.join();
+    commit_stage.join();
+
+    // What is left between the stages, and the batch the split stage was still adding files to
+    std::shared_ptr<SortBatch> batch;
+    while (batches_queue->dequeue_with_timeout(0, batch))
+    {
+        drop_batch(batch);
+    }
+    std::string resampled_file_path;
+    while (results_queue->dequeue_with_timeout(0, resampled_file_path))
+    {
+        drop_result(resampled_file_path);
+    }
+    s.discard_batch();
     dir_poller_bridge.join();
     log_processor.stop();
     log_processor.join();
@@ -1,5 +1,24 @@
 #include "Base.hh"
 
+#include "CSVTokenizer.h"
+#include "Codec.h"
+#include "RadixSort.h"
+#include "RowTable.h"
+#include "SignalChannel.h"
+#include "Sorter.h"
+#include "SorterBuilder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
 double foo = 2.0;
 double bar = 1.0;
 
@@ -18,8 +37,297 @@ void testAdvanced()
     // a more advanced test
 }
 
+std::vector<std::string> tokenize(const std::string &line, CSVTokenizer::Implementation implementation)
+{
+    std::string bytes;
+    std::vector<FieldRef> refs;
+    size_t count = CSVTokenizer::tokenize(line, bytes, refs, implementation);
+    ALEPH_ASSERT_EQUAL(count, refs.size());
+
+    std::vector<std::string> fields;
+    for (const auto &ref : refs)
+    {
+        fields.push_back(bytes.substr(ref.offset, ref.length));
+    }
+    return fields;
+}
+
+void testTokenizers()
+{
+    ALEPH_TEST_BEGIN("Tokenizers");
+
+    ALEPH_ASSERT_EQUAL(tokenize("", CSVTokenizer::Implementation::Scalar).size(), 1);
+    ALEPH_ASSERT_THROW(tokenize("\"\"", CSVTokenizer::Implementation::Scalar) == std::vector<std::string>({""}));
+    ALEPH_ASSERT_THROW(tokenize("\"ab\"c", CSVTokenizer::Implementation::Scalar) == std::vector<std::string>({"ab"}));
+    ALEPH_ASSERT_THROW(tokenize("a,\"b,c\",\"d\"\"e\"", CSVTokenizer::Implementation::Scalar) == std::vector<std::string>({"a", "b,c", "d\"e"}));
+
+    std::vector<std::string> lines({"", "\"\"", "\"ab\"c", ",", "\"", "a,\"b,c\",\"d\"\"e\"", "\"\",\"\",\"\""});
+
+    // Quotes and commas on both sides of the 32 byte block edge
+    for (size_t at = 24; at <= 40; ++at)
+    {
+        for (const std::string tail : {",", "\"", "\"\"", "\",\"", "\"a,b\"", "\"a\"\"b\",c", "\"ab\"c,d", ",\"\","})
+        {
+            lines.push_back(std::string(at, 'x') + tail + std::string(40, 'y'));
+            lines.push_back("\"" + std::string(at - 1, 'x') + tail + std::string(40, 'y'));
+        }
+    }
+
+    // Lines made of nothing but structural characters and a letter, across several blocks
+    std::mt19937 random(42);
+    const std::string alphabet(",\"a");
+    for (size_t i = 0; i < 2000; ++i)
+    {
+        std::string line(random() % 100, ' ');
+        for (auto &c : line)
+        {
+            c = alphabet[random() % alphabet.size()];
+        }
+        lines.push_back(line);
+    }
+
+    for (auto implementation : {CSVTokenizer::Implementation::SSE42, CSVTokenizer::Implementation::AVX2})
+    {
+        if (!CSVTokenizer::is_supported(implementation))
+        {
+            std::cerr << CSVTokenizer::to_string(implementation) << " not supported, skipped...";
+            continue;
+        }
+
+        for (const auto &line : lines)
+        {
+            ALEPH_ASSERT_THROW(tokenize(line, implementation) == tokenize(line, CSVTokenizer::Implementation::Scalar));
+        }
+    }
+
+    ALEPH_TEST_END();
+}
+
+void testCodecRoundTrip()
+{
+    ALEPH_TEST_BEGIN("LZCodec round trip");
+
+    LZCodec codec;
+    std::mt19937 random(42);
+
+    std::string rows;
+    for (size_t i = 0; rows.size() < 200000; ++i)
+    {
+        rows += "id" + std::to_string(random() % 1000) + "," + std::to_string(1600000000 + i) + "\n";
+    }
+    std::string noise(100000, ' ');
+    for (auto &c : noise)
+    {
+        c = static_cast<char>(random());
+    }
+
+    for (const std::string &data : {std::string(), std::string("a"), std::string("abcabcabcabcabcabc"), std::string(100000, 'z'), rows, noise})
+    {
+        std::string compressed(codec.max_compressed_size(data.size()), '\0');
+        compressed.resize(codec.compress(data.data(), data.size(), compressed.data()));
+
+        std::string decompressed(data.size(), '\0');
+        codec.decompress(compressed.data(), compressed.size(), decompressed.data(), decompressed.size());
+        ALEPH_ASSERT_THROW(decompressed == data);
+
+        std::string frame;
+        std::string block;
+        encode_block(codec, data.data(), data.size(), frame, nullptr);
+        BlockHeader header;
+        std::memcpy(&header, frame.data(), sizeof(header));
+        ALEPH_ASSERT_EQUAL(header.raw_size, data.size());
+        ALEPH_ASSERT_EQUAL(frame.size(), sizeof(header) + header.stored_size);
+        decode_block(codec, header, frame.data() + sizeof(header), block, nullptr);
+        ALEPH_ASSERT_THROW(block == data);
+    }
+
+    std::string compressed(codec.max_compressed_size(rows.size()), '\0');
+    compressed.resize(codec.compress(rows.data(), rows.size(), compressed.data()));
+    ALEPH_ASSERT_THROW(compressed.size() < rows.size() / 2);
+
+    ALEPH_TEST_END();
+}
+
+bool decompress_throws(const std::string &compressed, size_t raw_size)
+{
+    LZCodec codec;
+    std::string out(raw_size, '\0');
+    try
+    {
+        codec.decompress(compressed.data(), compressed.size(), out.data(), out.size());
+    }
+    catch (const std::runtime_error &)
+    {
+        return true;
+    }
+    return false;
+}
+
+void testCodecCorruptInput()
+{
+    ALEPH_TEST_BEGIN("LZCodec corrupt input");
+
+    LZCodec codec;
+    std::string data;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        data += "row," + std::to_string(i % 37) + "\n";
+    }
+    std::string compressed(codec.max_compressed_size(data.size()), '\0');
+    compressed.resize(codec.compress(data.data(), data.size(), compressed.data()));
+
+    // Sizes that don't add up
+    ALEPH_ASSERT_THROW(decompress_throws(compressed, data.size() + 1));
+    ALEPH_ASSERT_THROW(decompress_throws(compressed, data.size() - 1));
+    ALEPH_ASSERT_THROW(decompress_throws(compressed, 0));
+
+    // Literals past the end of the input
+    ALEPH_ASSERT_THROW(decompress_throws(std::string("\x50" "ab", 3), 5));
+
+    // Match offsets of zero and before the start of the output
+    ALEPH_ASSERT_THROW(decompress_throws(std::string("\x10" "a" "\x00\x00", 4), 5));
+    ALEPH_ASSERT_THROW(decompress_throws(std::string("\x10" "a" "\x02\x00", 4), 5));
+
+    // Truncated offset
+    ALEPH_ASSERT_THROW(decompress_throws(std::string("\x10" "a" "\x01", 3), 5));
+
+    ALEPH_TEST_END();
+}
+
+/*
+Rows of n ids with the given length, many of them duplicates, so equal keys have to keep their input order.
+*/
+std::vector<std::string> radix_rows(size_t n, size_t id_length, std::mt19937 &random)
+{
+    const std::string alphabet("0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz");
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < n; ++i)
+    {
+        std::string id(1 + random() % id_length, ' ');
+        for (auto &c : id)
+        {
+            c = alphabet[random() % 12];
+        }
+        lines.push_back(id + "," + std::to_string(random() % 50) + "," + std::to_string(i));
+    }
+    return lines;
+}
+
+void testRadixSort()
+{
+    ALEPH_TEST_BEGIN("RadixSort against std::stable_sort");
+
+    std::mt19937 random(42);
+
+    // One word keys (short ids), two and three words (numbers or longer ids), too long for radix sorting
+    const std::vector<std::pair<size_t, std::vector<size_t>>> cases({{2, {0}}, {3, {1}}, {3, {0, 1}}, {10, {0, 1}}, {30, {0, 1}}});
+    for (const auto &[id_length, columns] : cases)
+    {
+        for (size_t n : {size_t(100), size_t(5000), size_t(50000)})
+        {
+            RowTable radix;
+            RowTable comparison;
+            radix.set_key_columns(columns);
+            comparison.set_key_columns(columns);
+            for (const auto &line : radix_rows(n, id_length, random))
+            {
+                radix.append(line);
+                comparison.append(line);
+            }
+
+            bool sorted = RadixSort::sort(radix);
+            ALEPH_ASSERT_EQUAL(sorted, n >= RadixSort::MIN_ROWS && id_length <= 10);
+            if (!sorted)
+            {
+                continue;
+            }
+
+            std::stable_sort(comparison.rows().begin(), comparison.rows().end(), [&comparison](const RowRef &a, const RowRef &b)
+                             { return comparison.is_smaller(a, b); });
+            for (size_t i = 0; i < n; ++i)
+            {
+                ALEPH_ASSERT_THROW(radix[i][2] == comparison[i][2]);
+            }
+        }
+    }
+
+    ALEPH_TEST_END();
+}
+
+std::string read_file(const std::string &file_path)
+{
+    std::ifstream in(file_path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+/*
+Sorts file_path with a fresh sorter and returns the result. The final merge of plain runs is split into key ranges,
+compressed runs are never merged in ranges.
+*/
+std::string sort_file(const std::string &file_path, bool compress_runs, bool resample, SortStats &stats)
+{
+    Sorter sorter = Sorter::builder("Test")
+                        .with_sig_channel(std::make_shared<SignalChannel>())
+                        .with_threads(4)
+                        .with_memory_budget_mb(16)
+                        .with_max_fan_in(4)
+                        .with_compressed_runs(compress_runs)
+                        .with_direct_io(DirectIO::Never)
+                        .build();
+
+    std::string result_path = resample ? sorter.sort_and_resample({file_path}, 15) : sorter.sort({file_path});
+    std::string result = read_file(result_path);
+    std::filesystem::remove(result_path);
+    stats = sorter.stats();
+    return result;
+}
+
+void testPartitionedMerge()
+{
+    ALEPH_TEST_BEGIN("Partitioned merge against merge in one piece");
+
+    // A few megabytes of ids with many timestamps each and duplicate rows, so there are several runs and ranges
+    const std::string file_path = std::string(CMAKE_CURRENT_BINARY_DIR) + "/partitioned_merge.csv";
+    {
+        std::mt19937 random(42);
+        std::ofstream out(file_path);
+        out << "id,timestamp\n";
+        for (size_t i = 0; i < 400000; ++i)
+        {
+            std::stringstream row;
+            row << "id" << random() % 3000 << "," << random() % 200000 << "\n";
+            out << row.str();
+            if (i % 10 == 0)
+            {
+                out << row.str();
+            }
+        }
+    }
+
+    for (bool resample : {false, true})
+    {
+        SortStats stats;
+        std::string partitioned = sort_file(file_path, false, resample, stats);
+        ALEPH_ASSERT_THROW(stats.merge_ranges > 1);
+        ALEPH_ASSERT_THROW(stats.merge_passes > 1);
+        std::string in_one_piece = sort_file(file_path, true, resample, stats);
+        ALEPH_ASSERT_EQUAL(stats.merge_ranges, 1);
+        ALEPH_ASSERT_THROW(!partitioned.empty());
+        ALEPH_ASSERT_THROW(partitioned == in_one_piece);
+    }
+
+    std::filesystem::remove(file_path);
+
+    ALEPH_TEST_END();
+}
+
 int main(int, char **)
 {
     testBasic();
     testAdvanced();
+    testTokenizers();
+    testCodecRoundTrip();
+    testCodecCorruptInput();
+    testRadixSort();
+    testPartitionedMerge();
 }